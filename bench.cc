@@ -0,0 +1,163 @@
+#include "carddb.h"
+#include "file.h"
+#include "json.h"
+#include <chrono>
+#include <iostream>
+#include <string>
+
+class null_callbacks : public json_callbacks {
+public:
+	void null() { }
+	void boolean(const json_boolean &value) { }
+	void number(const json_number &value) { }
+	void string(const json_string &value) { }
+	void array_begin() { }
+	void array_end() { }
+	void object_begin() { }
+	void object_end() { }
+};
+
+class json_writer {
+public:
+	json_writer(bool pretty) : _pretty(pretty), _depth(0), _first(true), _keyed(false) { }
+	json_writer &begin(char c) {
+		separate();
+		_out += c;
+		++_depth;
+		_first = true;
+		return *this;
+	}
+	json_writer &end(char c) {
+		--_depth;
+		if(!_first)
+			newline();
+		_out += c;
+		_first = false;
+		return *this;
+	}
+	json_writer &key(const char *key) {
+		separate();
+		_out += '"';
+		_out += key;
+		_out += _pretty ? "\": " : "\":";
+		_first = true;
+		_keyed = true;
+		return *this;
+	}
+	json_writer &value(const std::string &value) {
+		separate();
+		_out += value;
+		_first = false;
+		return *this;
+	}
+	json_writer &string(const std::string &value) {
+		return this->value('"' + value + '"');
+	}
+	const std::string &str() const { return _out; }
+private:
+	void newline() {
+		if(_pretty) {
+			_out += '\n';
+			_out.append(2*_depth, ' ');
+		}
+	}
+	void separate() {
+		if(_keyed) {
+			_keyed = false;
+			return;
+		}
+		if(!_first)
+			_out += ',';
+		if(_depth)
+			newline();
+		_first = false;
+	}
+	std::string _out;
+	bool _pretty;
+	int _depth;
+	bool _first;
+	bool _keyed;
+};
+
+std::string make_cards(int sets, int cards, bool pretty) {
+	static const char *names[] = {"Shivan Dragon", "Llanowar Elves", "Lightning Bolt", "Counterspell", "Dark Ritual"};
+	static const char *costs[] = {"{4}{R}{R}", "{G}", "{R}", "{U}{U}", "{B}"};
+	json_writer out(pretty);
+	out.begin('{');
+	for(int i = 0; i < sets; ++i) {
+		out.key(("SET" + std::to_string(i)).c_str()).begin('{');
+		out.key("name").string("Set " + std::to_string(i));
+		out.key("code").string("SET" + std::to_string(i));
+		out.key("cards").begin('[');
+		for(int j = 0; j < cards; ++j) {
+			int k = (i + j) % 5;
+			out.begin('{');
+			out.key("name").string(names[k]);
+			out.key("manaCost").string(costs[k]);
+			out.key("cmc").value(std::to_string(k + 1));
+			out.key("types").begin('[').string("Creature").end(']');
+			out.key("text").string("Flying\\n{R}: This creature gets +1/+0 until end of turn.");
+			out.key("multiverseid").value(std::to_string(1000 + i * cards + j));
+			out.key("rulings").begin('[');
+			out.begin('{').key("date").string("2004-10-04").key("text").string("It \\\"works\\\".").end('}');
+			out.end(']');
+			out.end('}');
+		}
+		out.end(']');
+		out.end('}');
+	}
+	out.end('}');
+	return out.str();
+}
+
+template <class Fn>
+double throughput(const std::string &input, Fn &&fn) {
+	double best = 0;
+	for(int i = 0; i < 5; ++i) {
+		auto start = std::chrono::steady_clock::now();
+		fn(input.data(), input.data() + input.size());
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		double rate = input.size() / elapsed.count() / 1e6;
+		if(rate > best)
+			best = rate;
+	}
+	return best;
+}
+
+void run_bench(const char *name, const std::string &input) {
+	double callbacks = throughput(input, [](const char *begin, const char *end) {
+		null_callbacks cb;
+		json_parse(begin, end, cb);
+	});
+	double document = throughput(input, [](const char *begin, const char *end) {
+		json_parse(begin, end);
+	});
+	double tape = throughput(input, [](const char *begin, const char *end) {
+		json_parse_tape(begin, end);
+	});
+	std::cout << name << " (" << input.size() / 1000000 << " MB): "
+	          << "one-pass " << (int)callbacks << " MB/s, "
+	          << "document " << (int)document << " MB/s, "
+	          << "tape " << (int)tape << " MB/s" << std::endl;
+}
+
+void run_load(const char *name, const std::string &input) {
+	const char *path = "bench-cards.json";
+	file::options(path).create().write().truncate().open().write(input.data(), input.size());
+	card_database db(path);
+	unlink(path);
+	const auto &profile = db.profile();
+	std::cout << name << " load: "
+	          << "map " << profile.map << " ms, "
+	          << "parse " << profile.parse << " ms, "
+	          << "cards " << profile.cards << " ms, "
+	          << "costs " << profile.costs << " ms (" << profile.distinct_costs << " distinct), "
+	          << "mana " << profile.mana << " ms, "
+	          << "names " << profile.names << " ms" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+	run_bench("minified", make_cards(100, 300, false));
+	run_bench("pretty-printed", make_cards(100, 300, true));
+	run_load("minified", make_cards(100, 300, false));
+}
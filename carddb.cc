@@ -1,339 +1,168 @@
 #include "file.h"
 #include "json.h"
 #include "carddb.h"
+#include <thread>
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
 
-card_database::cost &card_database::cost::operator+=(const card_database::cost &x) {
-	_white += x._white;
-	_2white += x._2white;
-	_whiteblue += x._whiteblue;
-	_whiteblack += x._whiteblack;
-	_whitered += x._whitered;
-	_whitegreen += x._whitegreen;
-	_whitephyrexian += x._whitephyrexian;
-	_blue += x._blue;
-	_2blue += x._2blue;
-	_bluewhite += x._bluewhite;
-	_blueblack += x._blueblack;
-	_bluered += x._bluered;
-	_bluegreen += x._bluegreen;
-	_bluephyrexian += x._bluephyrexian;
-	_black += x._black;
-	_2black += x._2black;
-	_blackred += x._blackred;
-	_blackgreen += x._blackgreen;
-	_blackphyrexian += x._blackphyrexian;
-	_red += x._red;
-	_2red += x._2red;
-	_redgreen += x._redgreen;
-	_redphyrexian += x._redphyrexian;
-	_green += x._green;
-	_2green += x._2green;
-	_greenphyrexian += x._greenphyrexian;
-	_colorless += x._colorless;
-	_x += x._x;
-	_y += x._y;
-	_z += x._z;
-	_halfwhite += x._halfwhite;
-	_halfblue += x._halfblue;
-	_halfblack += x._halfblack;
-	_halfred += x._halfred;
-	_halfgreen += x._halfgreen;
-	_exists += x._exists;
-	_tap += x._tap;
-	_untap += x._untap;
-	_generic += x._generic;
-	return *this;
-}
-
-bool card_database::cost::operator==(const card_database::cost &x) const {
-	return _white == x._white &&
-	       _2white == x._2white &&
-	       _whiteblue == x._whiteblue &&
-	       _whiteblack == x._whiteblack &&
-	       _whitered == x._whitered &&
-	       _whitegreen == x._whitegreen &&
-	       _whitephyrexian == x._whitephyrexian &&
-	       _blue == x._blue &&
-	       _2blue == x._2blue &&
-	       _bluewhite == x._bluewhite &&
-	       _blueblack == x._blueblack &&
-	       _bluered == x._bluered &&
-	       _bluegreen == x._bluegreen &&
-	       _bluephyrexian == x._bluephyrexian &&
-	       _black == x._black &&
-	       _2black == x._2black &&
-	       _blackred == x._blackred &&
-	       _blackgreen == x._blackgreen &&
-	       _blackphyrexian == x._blackphyrexian &&
-	       _red == x._red &&
-	       _2red == x._2red &&
-	       _redgreen == x._redgreen &&
-	       _redphyrexian == x._redphyrexian &&
-	       _green == x._green &&
-	       _2green == x._2green &&
-	       _greenphyrexian == x._greenphyrexian &&
-	       _colorless == x._colorless &&
-	       _x == x._x &&
-	       _y == x._y &&
-	       _z == x._z &&
-	       _halfwhite == x._halfwhite &&
-	       _halfblue == x._halfblue &&
-	       _halfblack == x._halfblack &&
-	       _halfred == x._halfred &&
-	       _halfgreen == x._halfgreen &&
-	       _exists == x._exists &&
-	       _tap == x._tap &&
-	       _untap == x._untap &&
-	       _generic == x._generic;
-}
-
-void card_database::cost::parse_error() {
-	throw std::runtime_error("Invalid mana cost");
-}
-
-void card_database::cost::parse_next(json_string::const_iterator str, json_string::const_iterator end) {
-	_exists = 1;
-	if(str == end)
-		parse_error();
-	if(*str++ != '}')
-		parse_error();
-	return parse(str, end);
-}
-
-void card_database::cost::parse(json_string::const_iterator str, json_string::const_iterator end) {
-	if(str == end)
-		return;
-	if(*str++ != '{')
-		parse_error();
-	if(str == end)
-		parse_error();
-	switch(*str) {
-	case 'W':
-		++str;
-		if(str != end && *str == '/') {
-			++str;
-			if(str == end)
-				parse_error();
-			switch(*str++) {
-			case 'U':
-				++_whiteblue;
-				break;
-			case 'B':
-				++_whiteblack;
-				break;
-			case 'R':
-				++_whitered;
-				break;
-			case 'G':
-				++_whitegreen;
-				break;
-			case 'P':
-				++_whitephyrexian;
-				break;
-			default:
-				parse_error();
-			}
-		} else
-			++_white;
-		return parse_next(str, end);
-	case 'U':
-		++str;
-		if(str != end && *str == '/') {
-			++str;
-			if(str == end)
-				parse_error();
-			switch(*str++) {
-			case 'W':
-				++_whiteblue;
-				break;
-			case 'B':
-				++_blueblack;
-				break;
-			case 'R':
-				++_bluered;
-				break;
-			case 'G':
-				++_bluegreen;
-				break;
-			case 'P':
-				++_bluephyrexian;
-				break;
-			default:
-				parse_error();
-			}
-		} else
-			++_blue;
-		return parse_next(str, end);
-	case 'B':
-		++str;
-		if(str != end && *str == '/') {
-			++str;
-			if(str == end)
-				parse_error();
-			switch(*str++) {
-			case 'W':
-				++_whiteblack;
-				break;
-			case 'U':
-				++_bluered;
-				break;
-			case 'R':
-				++_blackred;
-				break;
-			case 'G':
-				++_blackgreen;
-				break;
-			case 'P':
-				++_blackphyrexian;
-				break;
-			default:
-				parse_error();
-			}
-		} else
-			++_black;
-		return parse_next(str, end);
-	case 'R':
-		++str;
-		if(str != end && *str == '/') {
-			++str;
+void card_database::cost::overflow_error() const {
+	throw std::overflow_error("Mana cost overflow");
+}
+
+namespace {
+
+enum mana_action {MANA_COUNT, MANA_HALF, MANA_TAP, MANA_UNTAP};
+
+struct mana_symbol {
+	uint32_t key;
+	uint8_t lane;
+	uint8_t action;
+};
+
+constexpr uint32_t mana_key(const char *str, int i = 0) {
+	return str[i] ? (uint32_t)(uint8_t)str[i] << 8*i | mana_key(str, i + 1) : 0;
+}
+
+constexpr mana_symbol mana_entry(const char *str, card_database::cost::lane_t lane, mana_action action = MANA_COUNT) {
+	return mana_symbol{mana_key(str), (uint8_t)lane, (uint8_t)action};
+}
+
+typedef card_database::cost mana;
+
+constexpr mana_symbol mana_symbols[] = {
+	mana_entry("W", mana::WHITE), mana_entry("U", mana::BLUE), mana_entry("B", mana::BLACK),
+	mana_entry("R", mana::RED), mana_entry("G", mana::GREEN), mana_entry("C", mana::COLORLESS),
+	mana_entry("X", mana::X), mana_entry("Y", mana::Y), mana_entry("Z", mana::Z),
+	mana_entry("T", mana::WHITE, MANA_TAP), mana_entry("Q", mana::WHITE, MANA_UNTAP), mana_entry("q", mana::WHITE, MANA_UNTAP),
+	mana_entry("hw", mana::HALFWHITE, MANA_HALF), mana_entry("hu", mana::HALFBLUE, MANA_HALF),
+	mana_entry("hb", mana::HALFBLACK, MANA_HALF), mana_entry("hr", mana::HALFRED, MANA_HALF),
+	mana_entry("hg", mana::HALFGREEN, MANA_HALF),
+	mana_entry("W/U", mana::WHITEBLUE), mana_entry("U/W", mana::WHITEBLUE),
+	mana_entry("W/B", mana::WHITEBLACK), mana_entry("B/W", mana::WHITEBLACK),
+	mana_entry("W/R", mana::WHITERED), mana_entry("R/W", mana::WHITERED),
+	mana_entry("W/G", mana::WHITEGREEN), mana_entry("G/W", mana::WHITEGREEN),
+	mana_entry("U/B", mana::BLUEBLACK), mana_entry("B/U", mana::BLUEBLACK),
+	mana_entry("U/R", mana::BLUERED), mana_entry("R/U", mana::BLUERED),
+	mana_entry("U/G", mana::BLUEGREEN), mana_entry("G/U", mana::BLUEGREEN),
+	mana_entry("B/R", mana::BLACKRED), mana_entry("R/B", mana::BLACKRED),
+	mana_entry("B/G", mana::BLACKGREEN), mana_entry("G/B", mana::BLACKGREEN),
+	mana_entry("R/G", mana::REDGREEN), mana_entry("G/R", mana::REDGREEN),
+	mana_entry("W/P", mana::WHITEPHYREXIAN), mana_entry("U/P", mana::BLUEPHYREXIAN),
+	mana_entry("B/P", mana::BLACKPHYREXIAN), mana_entry("R/P", mana::REDPHYREXIAN),
+	mana_entry("G/P", mana::GREENPHYREXIAN),
+	mana_entry("2/W", mana::TWOWHITE), mana_entry("2/U", mana::TWOBLUE), mana_entry("2/B", mana::TWOBLACK),
+	mana_entry("2/R", mana::TWORED), mana_entry("2/G", mana::TWOGREEN)
+};
+
+constexpr size_t mana_symbol_count = sizeof(mana_symbols) / sizeof(mana_symbols[0]);
+
+constexpr unsigned mana_slot(uint32_t key) {
+	return (uint32_t)(key * 0x948cd39fU) >> 25;
+}
+
+constexpr bool mana_distinct(size_t i, size_t j) {
+	return j == mana_symbol_count ||
+	       (mana_slot(mana_symbols[i].key) != mana_slot(mana_symbols[j].key) && mana_distinct(i, j + 1));
+}
+
+constexpr bool mana_perfect(size_t i = 0) {
+	return i == mana_symbol_count || (mana_distinct(i, i + 1) && mana_perfect(i + 1));
+}
+
+static_assert(mana_perfect(), "Mana symbol hash has collisions");
+
+constexpr uint8_t mana_find(unsigned slot, size_t i = 0) {
+	return i == mana_symbol_count ? 0xff : mana_slot(mana_symbols[i].key) == slot ? i : mana_find(slot, i + 1);
+}
+
+#define MANA_SLOTS4(n) mana_find(n), mana_find(n+1), mana_find(n+2), mana_find(n+3)
+#define MANA_SLOTS16(n) MANA_SLOTS4(n), MANA_SLOTS4(n+4), MANA_SLOTS4(n+8), MANA_SLOTS4(n+12)
+#define MANA_SLOTS64(n) MANA_SLOTS16(n), MANA_SLOTS16(n+16), MANA_SLOTS16(n+32), MANA_SLOTS16(n+48)
+constexpr uint8_t mana_slots[128] = {MANA_SLOTS64(0), MANA_SLOTS64(64)};
+#undef MANA_SLOTS64
+#undef MANA_SLOTS16
+#undef MANA_SLOTS4
+
+}
+
+template <class Iterator>
+card_database::cost::status card_database::cost::parse_symbols(Iterator str, Iterator end, cost &res) {
+	cost x;
+	while(str != end) {
+		if(*str != '{')
+			return UNKNOWN_SYMBOL;
+		uint32_t key = 0;
+		uint64_t value = 0;
+		unsigned size = 0;
+		bool digits = true;
+		for(++str;; ++str) {
 			if(str == end)
-				parse_error();
-			switch(*str++) {
-			case 'W':
-				++_whitered;
-				break;
-			case 'U':
-				++_bluered;
-				break;
-			case 'B':
-				++_blackred;
-				break;
-			case 'G':
-				++_redgreen;
+				return UNTERMINATED;
+			const char c = *str;
+			if(c == '}')
 				break;
-			case 'P':
-				++_redphyrexian;
-				break;
-			default:
-				parse_error();
-			}
-		} else
-			++_red;
-		return parse_next(str, end);
-	case 'G':
+			if(c >= '0' && c <= '9') {
+				value = value*10 + (c - '0');
+				if(value > 0x7fffffff)
+					return TOO_LARGE;
+			} else
+				digits = false;
+			if(size < 4)
+				key |= (uint32_t)(uint8_t)c << 8*size;
+			++size;
+		}
 		++str;
-		if(str != end && *str == '/') {
-			++str;
-			if(str == end)
-				parse_error();
-			switch(*str++) {
-			case 'W':
-				++_whitegreen;
+		if(!size)
+			return UNKNOWN_SYMBOL;
+		if(digits) {
+			if(x.generic())
+				return REPEATED_GENERIC;
+			x._words[4] |= value << 32;
+		} else {
+			const uint8_t i = size > 3 ? 0xff : mana_slots[mana_slot(key)];
+			if(i == 0xff || mana_symbols[i].key != key)
+				return UNKNOWN_SYMBOL;
+			const unsigned lane = mana_symbols[i].lane;
+			const uint64_t one = (uint64_t)1 << (lane & 7) * 8;
+			switch(mana_symbols[i].action) {
+			case MANA_COUNT:
+				if(x.lane((lane_t)lane) == 0x7f)
+					return TOO_LARGE;
+				x._words[lane >> 3] += one;
 				break;
-			case 'U':
-				++_bluegreen;
+			case MANA_HALF:
+				x._words[lane >> 3] |= one;
 				break;
-			case 'B':
-				++_blackgreen;
+			case MANA_TAP:
+				x._words[4] |= TAP;
 				break;
-			case 'R':
-				++_redgreen;
+			case MANA_UNTAP:
+				x._words[4] |= UNTAP;
 				break;
-			case 'P':
-				++_redphyrexian;
-				break;
-			default:
-				parse_error();
-			}
-		} else
-			++_green;
-		return parse_next(str, end);
-	case 'C':
-		++_colorless;
-		return parse_next(++str, end);
-	case 'X':
-		++_x;
-		return parse_next(++str, end);
-	case 'Y':
-		++_y;
-		return parse_next(++str, end);
-	case 'Z':
-		++_z;
-		return parse_next(++str, end);
-	case 'T':
-		_tap = 1;
-		return parse_next(++str, end);
-	case 'q':
-		_untap = 1;
-		return parse_next(++str, end);
-	case 'h':
-		++str;
-		if(str == end)
-			parse_error();
-		switch(*str++) {
-		case 'w':
-			_halfwhite = 1;
-			break;
-		case 'u':
-			_halfblue = 1;
-			break;
-		case 'b':
-			_halfblack = 1;
-			break;
-		case 'r':
-			_halfred = 1;
-			break;
-		case 'g':
-			_halfgreen = 1;
-			break;
-		default:
-			parse_error();
-		}
-		return parse_next(str, end);
-	case '0':
-	case '1':
-	case '2': {
-		auto str2 = str; ++str2;
-		if(str2 != end && *str2 == '/') {
-			++str2;
-			if(str == end)
-				parse_error();
-			switch(*str2++) {
-				case 'W':
-					++_2white;
-					break;
-				case 'U':
-					++_2blue;
-					break;
-				case 'B':
-					++_2black;
-					break;
-				case 'R':
-					++_2red;
-					break;
-				case 'G':
-					++_2green;
-					break;
 			}
-			return parse_next(str2, end);
 		}
+		x._words[4] |= EXISTS;
 	}
-	case '3':
-	case '4':
-	case '5':
-	case '6':
-	case '7':
-	case '8':
-	case '9':
-		if(_generic != 0)
-			parse_error();
-		while(str != end && *str >= '0' && *str <= '9') {
-			_generic = _generic*10 + (*str++ - '0');
-		}
-		return parse_next(str, end);
-	default:
-		parse_error();
+	res = x;
+	return VALID;
+}
+
+card_database::cost::status card_database::cost::parse(const char *begin, const char *end, cost &res) {
+	return parse_symbols(begin, end, res);
+}
+
+card_database::cost::status card_database::cost::parse(const json_string &x, cost &res) {
+	return parse_symbols(x.begin(), x.end(), res);
+}
+
+size_t card_database::cost::parse(const json_string *x, size_t n, cost *res, status *statuses) {
+	size_t invalid = 0;
+	for(size_t i = 0; i < n; ++i) {
+		statuses[i] = parse(x[i], res[i]);
+		invalid += statuses[i] != VALID;
 	}
+	return invalid;
 }
 
 void card_database::deck::init() {
@@ -341,30 +170,548 @@ void card_database::deck::init() {
 	json_object val = doc;
 	_name = val["name"];
 	for(const json_object &card: json_array(val["deck"])) {
-		_deck.emplace_back(_parent.find_card(card["name"]), (int)json_number(card["count"]));
+		_deck.emplace_back(_parent.find_card(card["name"]), (int)json_number(card["count"]).integer());
 	}
 	for(const json_object &card: json_array(val["sideboard"])) {
-		_sideboard.emplace_back(_parent.find_card(card["name"]), (int)json_number(card["count"]));
+		_sideboard.emplace_back(_parent.find_card(card["name"]), (int)json_number(card["count"]).integer());
 	}
 }
 
-card_database::card_database(const char *filename) : _mapping(load(filename)), _sets(parse(_mapping)) {
+static const struct {
+	const char *key;
+	json_atom card_database::fields::*atom;
+} card_database_keys[] = {
+	{"id", &card_database::fields::id},
+	{"layout", &card_database::fields::layout},
+	{"name", &card_database::fields::name},
+	{"names", &card_database::fields::names},
+	{"manaCost", &card_database::fields::mana_cost},
+	{"cmc", &card_database::fields::cmc},
+	{"colors", &card_database::fields::colors},
+	{"colorIdentity", &card_database::fields::color_identity},
+	{"type", &card_database::fields::type},
+	{"supertypes", &card_database::fields::supertypes},
+	{"types", &card_database::fields::types},
+	{"subtypes", &card_database::fields::subtypes},
+	{"rarity", &card_database::fields::rarity},
+	{"text", &card_database::fields::text},
+	{"flavor", &card_database::fields::flavor},
+	{"artist", &card_database::fields::artist},
+	{"number", &card_database::fields::number},
+	{"power", &card_database::fields::power},
+	{"toughness", &card_database::fields::toughness},
+	{"loyalty", &card_database::fields::loyalty},
+	{"multiverseid", &card_database::fields::multiverse_id},
+	{"code", &card_database::fields::code},
+	{"gathererCode", &card_database::fields::gatherer_code},
+	{"releaseDate", &card_database::fields::release_date},
+	{"border", &card_database::fields::border},
+	{"block", &card_database::fields::block},
+	{"onlineOnly", &card_database::fields::online_only},
+	{"cards", &card_database::fields::cards}
+};
+
+static_assert(sizeof(card_database::fields) == sizeof(card_database_keys) / sizeof(card_database_keys[0]) * sizeof(json_atom),
+              "Every card field needs a key");
+
+card_database::fields::fields(const json_tape &x) {
+	for(const auto &key: card_database_keys)
+		this->*key.atom = x.atom(key.key);
+}
+
+struct card_database_snapshot {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint64_t tape_offset;
+	uint64_t tape_size;
+	uint64_t names_offset;
+	uint64_t name_slots;
+	uint64_t columns_offset;
+	uint64_t column_count;
+};
+
+struct card_database_column {
+	uint32_t id;
+	uint32_t width;
+	uint64_t offset;
+	uint64_t count;
+};
+
+enum card_database_column_t {
+	COLUMN_OBJECTS, COLUMN_SET_FIRST, COLUMN_CMC, COLUMN_COLORS, COLUMN_TYPES, COLUMN_SUPERTYPES,
+	COLUMN_COST_INDEX, COLUMN_COSTS, COLUMN_POWER, COLUMN_TOUGHNESS, COLUMN_STATS,
+	COLUMN_MANA_INDEX, COLUMN_MANA_ABILITIES, COLUMN_MANA_OPTIONS
+};
+
+static const char card_database_magic[8] = {'D', 'E', 'C', 'K', 'E', 'V', 'D', 'B'};
+static const uint32_t card_database_version = 4;
+static const uint32_t card_database_byte_order = 0x01020304;
+
+static const card_database_snapshot *snapshot_header(const mapping &data) {
+	if(data.size() < sizeof(card_database_snapshot) || memcmp(data.data(), card_database_magic, sizeof(card_database_magic)))
+		return nullptr;
+	auto header = (const card_database_snapshot *)data.data();
+	if(header->version != card_database_version || header->byte_order != card_database_byte_order)
+		throw std::runtime_error("Unsupported card database snapshot version");
+	if(header->tape_offset > data.size() || header->tape_size > data.size() - header->tape_offset ||
+	   header->names_offset > data.size() || header->names_offset % sizeof(uint64_t) ||
+	   !header->name_slots || header->name_slots & (header->name_slots - 1) ||
+	   header->columns_offset > data.size() || header->columns_offset % sizeof(uint64_t) ||
+	   header->column_count > (data.size() - header->columns_offset) / sizeof(card_database_column))
+		throw std::runtime_error("Truncated card database snapshot");
+	return header;
+}
+
+template <class T>
+static void card_database_save_column(std::string &out, std::vector<card_database_column> &columns, uint32_t id, const card_database::column<T> &x) {
+	out.resize((out.size() + 7) & ~(size_t)7);
+	columns.push_back(card_database_column{id, sizeof(T), out.size(), x.size()});
+	out.append((const char *)x.data(), x.size() * sizeof(T));
+}
+
+template <class T>
+static void card_database_view_column(const mapping &data, uint32_t id, card_database::column<T> &x) {
+	auto header = (const card_database_snapshot *)data.data();
+	auto columns = (const card_database_column *)((const char *)data.data() + header->columns_offset);
+	for(uint64_t i = 0; i < header->column_count; ++i) {
+		const card_database_column &c = columns[i];
+		if(c.id != id)
+			continue;
+		if(c.width != sizeof(T) || c.offset > data.size() || c.offset % alignof(T) || c.count > (data.size() - c.offset) / sizeof(T))
+			throw std::runtime_error("Truncated card database snapshot");
+		x.view((const T *)((const char *)data.data() + c.offset), c.count);
+		return;
+	}
+	throw std::runtime_error("Truncated card database snapshot");
+}
+
+static double card_database_lap(std::chrono::steady_clock::time_point &start) {
+	auto now = std::chrono::steady_clock::now();
+	std::chrono::duration<double, std::milli> res = now - start;
+	start = now;
+	return res.count();
+}
+
+card_database::card_database(const char *filename) : _profile(), _mapping(load(filename, _profile)), _sets(parse(_mapping, _profile)), _fields(_sets) {
+	auto start = std::chrono::steady_clock::now();
+	if(snapshot_header(_mapping))
+		view_cards();
+	else
+		index_cards();
+	_profile.cards = card_database_lap(start) - _profile.costs;
+	if(snapshot_header(_mapping))
+		view_mana();
+	else
+		index_mana();
+	_profile.mana = card_database_lap(start);
+	if(auto header = snapshot_header(_mapping)) {
+		_names = (const name_slot *)((const char *)_mapping.data() + header->names_offset);
+		_name_mask = header->name_slots - 1;
+		if(header->name_slots > (_mapping.size() - header->names_offset) / sizeof(name_slot))
+			throw std::runtime_error("Truncated card database snapshot");
+		bool empty = false;
+		for(size_t i = 0; i < header->name_slots; ++i) {
+			if(_names[i].card > _table.size())
+				throw std::runtime_error("Truncated card database snapshot");
+			empty = empty || !_names[i].card;
+		}
+		if(!empty)
+			throw std::runtime_error("Truncated card database snapshot");
+	} else
+		index_names();
+	_profile.names = card_database_lap(start);
+}
+
+struct card_database_bit {
+	const char *name;
+	unsigned bit;
+};
+
+static const card_database_bit card_database_colors[] = {
+	{"White", card_database::WHITE}, {"Blue", card_database::BLUE}, {"Black", card_database::BLACK},
+	{"Red", card_database::RED}, {"Green", card_database::GREEN}
+};
+
+static const card_database_bit card_database_types[] = {
+	{"Artifact", card_database::ARTIFACT}, {"Creature", card_database::CREATURE},
+	{"Enchantment", card_database::ENCHANTMENT}, {"Instant", card_database::INSTANT},
+	{"Land", card_database::LAND}, {"Planeswalker", card_database::PLANESWALKER},
+	{"Sorcery", card_database::SORCERY}, {"Tribal", card_database::TRIBAL},
+	{"Conspiracy", card_database::CONSPIRACY}, {"Phenomenon", card_database::PHENOMENON},
+	{"Plane", card_database::PLANE}, {"Scheme", card_database::SCHEME},
+	{"Vanguard", card_database::VANGUARD}
+};
+
+static const card_database_bit card_database_basic_types[] = {
+	{"Plains", card_database::WHITE}, {"Island", card_database::BLUE}, {"Swamp", card_database::BLACK},
+	{"Mountain", card_database::RED}, {"Forest", card_database::GREEN}
+};
+
+static const card_database_bit card_database_supertypes[] = {
+	{"Basic", card_database::BASIC}, {"Legendary", card_database::LEGENDARY},
+	{"Snow", card_database::SNOW}, {"World", card_database::WORLD},
+	{"Ongoing", card_database::ONGOING}
+};
+
+template <size_t N>
+static unsigned card_database_mask(const json_tape_value &x, const card_database_bit (&bits)[N]) {
+	if(x.type() != json_tape_value::ARRAY)
+		return 0;
+	unsigned res = 0;
+	for(json_string name: json_tape_array(x)) {
+		for(const auto &bit: bits) {
+			if(name == bit.name) {
+				res |= bit.bit;
+				break;
+			}
+		}
+	}
+	return res;
+}
+
+static int card_database_stat(const json_string &x, bool &star) {
+	auto it = x.begin(), end = x.end();
+	bool negative = false;
+	if(it != end && (*it == '-' || *it == '+'))
+		negative = *it++ == '-';
+	int res = 0;
+	for(; it != end && *it >= '0' && *it <= '9'; ++it)
+		res = std::min(res * 10 + (*it - '0'), 127);
+	star = it != end;
+	return negative ? -res : res;
+}
+
+void card_database::index_cards() {
 	size_t cards = 0;
+	std::vector<uint32_t> set_first;
 	for(auto set: sets()) {
-		cards += set.cards().size();
-	}
-	_cards.reserve(cards);
+		set_first.push_back(cards);
+		cards += json_tape_array(set._set[_fields.cards]).size();
+	}
+	_table._set_first.assign(std::move(set_first));
+	std::vector<uint64_t> objects;
+	std::vector<uint32_t> cmc;
+	std::vector<uint8_t> colors;
+	std::vector<uint16_t> types;
+	std::vector<uint8_t> supertypes;
+	std::vector<uint32_t> cost_index;
+	std::vector<json_string> cost_strings;
+	std::unordered_map<json_string, uint32_t> costs;
+	std::vector<int8_t> power;
+	std::vector<int8_t> toughness;
+	std::vector<uint8_t> stats;
+	objects.reserve(cards);
+	cmc.reserve(cards);
+	colors.reserve(cards);
+	types.reserve(cards);
+	supertypes.reserve(cards);
+	cost_index.reserve(cards);
+	power.reserve(cards);
+	toughness.reserve(cards);
+	stats.reserve(cards);
 	for(auto set: sets()) {
 		for(auto card: set.cards()) {
-			_cards.emplace(card.name(), card);
+			unsigned flags = 0;
+			bool star;
+			objects.push_back(card._card.word());
+			cmc.push_back(card.int_or_zero(_fields.cmc));
+			colors.push_back(card_database_mask(card._card[_fields.colors], card_database_colors));
+			types.push_back(card_database_mask(card._card[_fields.types], card_database_types));
+			supertypes.push_back(card_database_mask(card._card[_fields.supertypes], card_database_supertypes));
+			const json_string mana_cost = card.string_or_empty(_fields.mana_cost);
+			auto res = costs.emplace(mana_cost, cost_strings.size());
+			if(res.second)
+				cost_strings.push_back(mana_cost);
+			cost_index.push_back(res.first->second);
+			json_tape_value x = card._card[_fields.power];
+			power.push_back(x.is_null() ? 0 : card_database_stat(x, star));
+			if(!x.is_null())
+				flags |= HAS_POWER | (star ? POWER_STAR : 0);
+			x = card._card[_fields.toughness];
+			toughness.push_back(x.is_null() ? 0 : card_database_stat(x, star));
+			if(!x.is_null())
+				flags |= HAS_TOUGHNESS | (star ? TOUGHNESS_STAR : 0);
+			stats.push_back(flags);
+		}
+	}
+	auto start = std::chrono::steady_clock::now();
+	std::vector<cost> parsed(cost_strings.size());
+	std::vector<cost::status> statuses(cost_strings.size());
+	if(cost::parse(cost_strings.data(), cost_strings.size(), parsed.data(), statuses.data())) {
+		for(size_t i = 0; i < cards; ++i) {
+			if(statuses[cost_index[i]] != cost::VALID)
+				stats[i] |= INVALID_COST;
+		}
+	}
+	_profile.costs = card_database_lap(start);
+	_profile.distinct_costs = parsed.size();
+	_table._objects.assign(std::move(objects));
+	_table._cmc.assign(std::move(cmc));
+	_table._colors.assign(std::move(colors));
+	_table._types.assign(std::move(types));
+	_table._supertypes.assign(std::move(supertypes));
+	_table._cost_index.assign(std::move(cost_index));
+	_table._costs.assign(std::move(parsed));
+	_table._power.assign(std::move(power));
+	_table._toughness.assign(std::move(toughness));
+	_table._stats.assign(std::move(stats));
+}
+
+void card_database::view_cards() {
+	card_database_view_column(_mapping, COLUMN_OBJECTS, _table._objects);
+	card_database_view_column(_mapping, COLUMN_SET_FIRST, _table._set_first);
+	card_database_view_column(_mapping, COLUMN_CMC, _table._cmc);
+	card_database_view_column(_mapping, COLUMN_COLORS, _table._colors);
+	card_database_view_column(_mapping, COLUMN_TYPES, _table._types);
+	card_database_view_column(_mapping, COLUMN_SUPERTYPES, _table._supertypes);
+	card_database_view_column(_mapping, COLUMN_COST_INDEX, _table._cost_index);
+	card_database_view_column(_mapping, COLUMN_COSTS, _table._costs);
+	card_database_view_column(_mapping, COLUMN_POWER, _table._power);
+	card_database_view_column(_mapping, COLUMN_TOUGHNESS, _table._toughness);
+	card_database_view_column(_mapping, COLUMN_STATS, _table._stats);
+	const size_t cards = _table.size();
+	if(_table._cmc.size() != cards || _table._colors.size() != cards || _table._types.size() != cards ||
+	   _table._supertypes.size() != cards || _table._cost_index.size() != cards || _table._power.size() != cards ||
+	   _table._toughness.size() != cards || _table._stats.size() != cards)
+		throw std::runtime_error("Truncated card database snapshot");
+	for(size_t i = 0; i < _table._set_first.size(); ++i) {
+		if(_table._set_first[i] > cards)
+			throw std::runtime_error("Truncated card database snapshot");
+	}
+	for(size_t i = 0; i < cards; ++i) {
+		if(_table._cost_index[i] >= _table._costs.size())
+			throw std::runtime_error("Truncated card database snapshot");
+	}
+	_profile.distinct_costs = _table._costs.size();
+}
+
+void card_database::view_mana() {
+	card_database_view_column(_mapping, COLUMN_MANA_INDEX, _table._mana_index);
+	card_database_view_column(_mapping, COLUMN_MANA_ABILITIES, _table._mana_abilities);
+	card_database_view_column(_mapping, COLUMN_MANA_OPTIONS, _table._mana_options);
+	if(_table._mana_index.size() != _table.size() || !_table._mana_abilities.size())
+		throw std::runtime_error("Truncated card database snapshot");
+	for(size_t i = 0; i < _table._mana_index.size(); ++i) {
+		if(_table._mana_index[i] >= _table._mana_abilities.size())
+			throw std::runtime_error("Truncated card database snapshot");
+	}
+	for(size_t i = 0; i < _table._mana_abilities.size(); ++i) {
+		const mana_ability &ability = _table._mana_abilities[i];
+		if(ability.first > _table._mana_options.size() || ability.count > _table._mana_options.size() - ability.first)
+			throw std::runtime_error("Truncated card database snapshot");
+	}
+}
+
+static bool card_database_prefix(const char *&it, const char *end, const char *prefix) {
+	const size_t n = strlen(prefix);
+	if((size_t)(end - it) < n || memcmp(it, prefix, n))
+		return false;
+	it += n;
+	return true;
+}
+
+static void card_database_mana_option(std::vector<card_database::cost> &options, const card_database::cost &option) {
+	if(std::find(options.begin(), options.end(), option) == options.end())
+		options.push_back(option);
+}
+
+static unsigned card_database_mana_colors(const card_database::cost &x) {
+	return (x.white() ? card_database::WHITE : 0) | (x.blue() ? card_database::BLUE : 0) |
+	       (x.black() ? card_database::BLACK : 0) | (x.red() ? card_database::RED : 0) |
+	       (x.green() ? card_database::GREEN : 0) | (x.colorless() ? card_database::COLORLESS : 0);
+}
+
+static const card_database::cost card_database_mana[6] = {
+	card_database::cost("{W}"), card_database::cost("{U}"), card_database::cost("{B}"),
+	card_database::cost("{R}"), card_database::cost("{G}"), card_database::cost("{C}")
+};
+
+static void card_database_mana_text(const char *begin, const char *end, std::vector<card_database::cost> &options) {
+	static const char needle[] = "{T}: Add ";
+	const char *it = begin;
+	while((it = (const char *)memchr(it, '{', end - it))) {
+		if(!card_database_prefix(it, end, needle)) {
+			++it;
+			continue;
+		}
+		const char *line = it - (sizeof(needle) - 1);
+		while(line != begin && line[-1] == '(')
+			--line;
+		if(line != begin && line[-1] != '\n')
+			continue;
+		const size_t first = options.size();
+		for(;;) {
+			card_database::cost option;
+			if(card_database_prefix(it, end, "one mana of any color")) {
+				for(int color = 0; color < 5; ++color)
+					card_database_mana_option(options, card_database_mana[color]);
+			} else {
+				const char *symbols = it;
+				while(it != end && *it == '{') {
+					while(it != end && *it != '}')
+						++it;
+					if(it != end)
+						++it;
+				}
+				if(symbols == it || card_database::cost::parse(symbols, it, option) != card_database::cost::VALID)
+					break;
+				if(option.generic() && !card_database_mana_colors(option)) {
+					const int generic = option.generic();
+					option = card_database::cost();
+					for(int i = 0; i < generic; ++i)
+						option += card_database_mana[5];
+				}
+				card_database_mana_option(options, option);
+			}
+			if(!card_database_prefix(it, end, ", or ") && !card_database_prefix(it, end, " or ") && !card_database_prefix(it, end, ", "))
+				break;
 		}
+		if(!card_database_prefix(it, end, ".") && !card_database_prefix(it, end, " to your mana pool."))
+			options.resize(first);
 	}
 }
 
-mapping card_database::load(const char *filename) {
-	return mapping::options()
+void card_database::index_mana() {
+	std::unordered_map<uint64_t, uint32_t> abilities;
+	std::vector<cost> options;
+	std::vector<uint32_t> mana_index;
+	std::vector<mana_ability> mana_abilities(1);
+	std::vector<cost> mana_options;
+	mana_index.reserve(_table.size());
+	for(uint32_t i = 0; i < _table.size(); ++i) {
+		const card c = get_card(i);
+		options.clear();
+		const json_string text = c.text();
+		if(text.data())
+			card_database_mana_text(text.data(), text.data() + text.size(), options);
+		else {
+			const std::string flat = text;
+			card_database_mana_text(flat.data(), flat.data() + flat.size(), options);
+		}
+		if(_table._types[i] & LAND) {
+			const unsigned basic_types = card_database_mask(c._card[_fields.subtypes], card_database_basic_types);
+			for(int color = 0; color < 5; ++color) {
+				if(basic_types & 1 << color)
+					card_database_mana_option(options, card_database_mana[color]);
+			}
+		}
+		if(options.empty()) {
+			mana_index.push_back(0);
+			continue;
+		}
+		uint64_t key = options.size();
+		for(const cost &option: options)
+			key = json_hash_mix(key ^ option.hash(), 0x9e3779b97f4a7c15ULL);
+		auto res = abilities.emplace(key, mana_abilities.size());
+		if(!res.second) {
+			const mana_ability &ability = mana_abilities[res.first->second];
+			if(ability.count == options.size() && std::equal(options.begin(), options.end(), mana_options.begin() + ability.first)) {
+				mana_index.push_back(res.first->second);
+				continue;
+			}
+		}
+		mana_ability ability = {(uint32_t)mana_options.size(), (uint16_t)options.size(), 0, 1};
+		for(const cost &option: options)
+			ability.colors |= card_database_mana_colors(option);
+		if(options.size() == 1 && !(ability.colors & (ability.colors - 1))) {
+			const cost &x = options[0];
+			ability.amount = x.white() + x.blue() + x.black() + x.red() + x.green() + x.colorless();
+		}
+		mana_index.push_back(mana_abilities.size());
+		mana_abilities.push_back(ability);
+		mana_options.insert(mana_options.end(), options.begin(), options.end());
+	}
+	_table._mana_index.assign(std::move(mana_index));
+	_table._mana_abilities.assign(std::move(mana_abilities));
+	_table._mana_options.assign(std::move(mana_options));
+}
+
+void card_database::index_names() {
+	const size_t cards = _table.size();
+	size_t slots = 16;
+	while(slots < cards * 2)
+		slots <<= 1;
+	_name_table.assign(slots, name_slot());
+	_names = _name_table.data();
+	_name_mask = slots - 1;
+	std::vector<json_string> names;
+	names.reserve(cards);
+	for(uint32_t i = 0; i < cards; ++i)
+		names.push_back(get_card(i).name());
+	for(uint32_t n = 0; n < cards; ++n) {
+		const uint64_t hash = names[n].hash();
+		size_t i = hash & _name_mask;
+		while(_name_table[i].card && !(_name_table[i].hash == hash && names[_name_table[i].card - 1] == names[n]))
+			i = (i + 1) & _name_mask;
+		name_slot &slot = _name_table[i];
+		if(!slot.card) {
+			slot.hash = hash;
+			slot.card = n + 1;
+		}
+	}
+}
+
+void card_database::save(const char *filename) const {
+	std::string out(sizeof(card_database_snapshot), '\0');
+	card_database_snapshot header;
+	memcpy(header.magic, card_database_magic, sizeof(header.magic));
+	header.version = card_database_version;
+	header.byte_order = card_database_byte_order;
+	header.tape_offset = out.size();
+	_sets.save(out);
+	header.tape_size = out.size() - header.tape_offset;
+	out.resize((out.size() + 7) & ~(size_t)7);
+	header.names_offset = out.size();
+	header.name_slots = _name_mask + 1;
+	out.append((const char *)_names, header.name_slots * sizeof(name_slot));
+	std::vector<card_database_column> columns;
+	card_database_save_column(out, columns, COLUMN_OBJECTS, _table._objects);
+	card_database_save_column(out, columns, COLUMN_SET_FIRST, _table._set_first);
+	card_database_save_column(out, columns, COLUMN_CMC, _table._cmc);
+	card_database_save_column(out, columns, COLUMN_COLORS, _table._colors);
+	card_database_save_column(out, columns, COLUMN_TYPES, _table._types);
+	card_database_save_column(out, columns, COLUMN_SUPERTYPES, _table._supertypes);
+	card_database_save_column(out, columns, COLUMN_COST_INDEX, _table._cost_index);
+	card_database_save_column(out, columns, COLUMN_COSTS, _table._costs);
+	card_database_save_column(out, columns, COLUMN_POWER, _table._power);
+	card_database_save_column(out, columns, COLUMN_TOUGHNESS, _table._toughness);
+	card_database_save_column(out, columns, COLUMN_STATS, _table._stats);
+	card_database_save_column(out, columns, COLUMN_MANA_INDEX, _table._mana_index);
+	card_database_save_column(out, columns, COLUMN_MANA_ABILITIES, _table._mana_abilities);
+	card_database_save_column(out, columns, COLUMN_MANA_OPTIONS, _table._mana_options);
+	out.resize((out.size() + 7) & ~(size_t)7);
+	header.columns_offset = out.size();
+	header.column_count = columns.size();
+	out.append((const char *)columns.data(), columns.size() * sizeof(card_database_column));
+	memcpy(&out[0], &header, sizeof(header));
+	file::options(filename).create().write().truncate().open().write(out.data(), out.size());
+}
+
+json_tape card_database::parse(mapping &data, load_profile &profile) {
+	auto start = std::chrono::steady_clock::now();
+	json_tape res;
+	if(auto header = snapshot_header(data))
+		res = json_tape::view((const char *)data.data() + header->tape_offset, header->tape_size);
+	else {
+		json_tape::options options;
+		options.threads(std::thread::hardware_concurrency());
+		for(const auto &key: card_database_keys)
+			options.keep(key.key);
+		auto str = (const char *)data.data();
+		res = options.parse(str, str+data.size());
+	}
+	profile.parse = card_database_lap(start);
+	return res;
+}
+
+mapping card_database::load(const char *filename, load_profile &profile) {
+	auto start = std::chrono::steady_clock::now();
+	mapping res = mapping::options()
 		.file(file::options(filename).open())
 		.map();
+	profile.map = card_database_lap(start);
+	return res;
 }
 
 std::ostream &operator<<(std::ostream &out, const card_database::cost &x) {
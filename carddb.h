@@ -5,68 +5,53 @@
 #include <iostream>
 #include <stdexcept>
 #include <vector>
-#include <unordered_map>
-
-namespace std {
-template <>
-struct hash<json_string> {
-	size_t operator()(const json_string &x) const noexcept {
-		static const size_t offset_basis = sizeof(size_t) == 4 ? 2166136261U : 14695981039346656037U;
-		static const size_t prime = sizeof(size_t) == 4 ? 16777619U : 1099511628211U;
-		size_t hash = offset_basis;
-		if(!x._multipart) {
-			const char *str = x._value;
-			const char *end = str+x._size;
-			while(str != end) {
-				hash ^= *str++;
-				hash *= prime;
-			}
-		} else {
-			json_string::extent *ext = x._next;
-			while(ext) {
-				const char *str = ext->value();
-				const char *end = str+ext->_size;
-				while(str != end) {
-					hash ^= *str++;
-					hash *= prime;
-				}
-				ext = ext->_next;
-			}
-		}
-		return hash;
-	}
-};
-}
 
 class card_database {
 public:
+	struct fields {
+		json_atom id, layout, name, names, mana_cost, cmc, colors, color_identity, type,
+		          supertypes, types, subtypes, rarity, text, flavor, artist, number, power,
+		          toughness, loyalty, multiverse_id, code, gatherer_code, release_date,
+		          border, block, online_only, cards;
+
+		fields(const json_tape &x);
+	};
+
 	template <class Value>
 	class object_collection {
 	public:
 		class iterator {
 		public:
-			Value operator*() const { return Value(_iterator->second); }
-			iterator &operator++() { ++_iterator; return *this; }
+			Value operator*() const { return Value(_iterator->second, _db, _index); }
+			iterator &operator++() { ++_iterator; ++_index; return *this; }
 			bool operator!=(const iterator &x) { return _iterator != x._iterator; }
 			friend class object_collection;
 		private:
-			typedef json_object::const_iterator native_iterator;
-			iterator(const native_iterator &x) : _iterator(x) { }
+			typedef json_tape_object::const_iterator native_iterator;
+			iterator(const native_iterator &x, const card_database *db, uint32_t index) : _iterator(x), _db(db), _index(index) { }
 			native_iterator _iterator;
+			const card_database *_db;
+			uint32_t _index;
 		};
 
-		iterator begin() const { return _collection.begin(); }
-		iterator end() const { return _collection.end(); }
+		iterator begin() const { return iterator(_collection.begin(), _db, 0); }
+		iterator end() const { return iterator(_collection.end(), _db, _collection.size()); }
 
 		Value operator[](const char *key) {
-			return Value(_collection[key]);
+			const json_string name(key, strlen(key));
+			for(auto it = begin(); it != end(); ++it) {
+				if(it._iterator->first == name)
+					return *it;
+			}
+			throw std::runtime_error("JSON object key not found");
 		}
 
 		friend class card_database;
 	private:
-		object_collection(const json_object &x) : _collection(x) { }
+		object_collection(const json_tape_object &x, const card_database *db) : _collection(x), _db(db) { }
 
-		json_object _collection;
+		json_tape_object _collection;
+		const card_database *_db;
 	};
 
 	template <class Value>
@@ -74,178 +59,302 @@ public:
 	public:
 		class iterator {
 		public:
-			Value operator*() const { return Value(*_iterator); }
-			iterator &operator++() { ++_iterator; return *this; }
+			Value operator*() const { return Value(*_iterator, _db, _index); }
+			iterator &operator++() { ++_iterator; ++_index; return *this; }
 			bool operator!=(const iterator &x) { return _iterator != x._iterator; }
 			friend class array_collection;
 		private:
-			typedef json_array::const_iterator native_iterator;
-			iterator(const native_iterator &x) : _iterator(x) { }
+			typedef json_tape_array::const_iterator native_iterator;
+			iterator(const native_iterator &x, const card_database *db, uint32_t index) : _iterator(x), _db(db), _index(index) { }
 			native_iterator _iterator;
+			const card_database *_db;
+			uint32_t _index;
 		};
 
-		iterator begin() const { return _collection.begin(); }
-		iterator end() const { return _collection.end(); }
+		iterator begin() const { return iterator(_collection.begin(), _db, _first); }
+		iterator end() const { return iterator(_collection.end(), _db, _first + _collection.size()); }
 		size_t size() const { return _collection.size(); }
 
 		friend class card_database;
 	private:
-		array_collection(const json_array &x) : _collection(x) { }
+		array_collection(const json_tape_array &x, const card_database *db, uint32_t first) : _collection(x), _db(db), _first(first) { }
 
-		json_array _collection;
+		json_tape_array _collection;
+		const card_database *_db;
+		uint32_t _first;
 	};
 
 	class cost {
 	public:
+		enum lane_t {
+			WHITE, TWOWHITE, WHITEBLUE, WHITEBLACK, WHITERED, WHITEGREEN, WHITEPHYREXIAN, BLUE,
+			TWOBLUE, BLUEBLACK, BLUERED, BLUEGREEN, BLUEPHYREXIAN, BLACK, TWOBLACK, BLACKRED,
+			BLACKGREEN, BLACKPHYREXIAN, RED, TWORED, REDGREEN, REDPHYREXIAN, GREEN, TWOGREEN,
+			GREENPHYREXIAN, COLORLESS, X, Y, Z, HALFWHITE, HALFBLUE, HALFBLACK,
+			HALFRED, HALFGREEN
+		};
+		enum status {VALID, UNTERMINATED, UNKNOWN_SYMBOL, REPEATED_GENERIC, TOO_LARGE};
+
 		cost() {
 			memset(this, 0, sizeof(*this));
 		}
 
 		cost(const json_string &x) : cost() {
-			try {
-				parse(x.begin(), x.end());
-			} catch (const std::exception &e) {
+			if(parse(x, *this) != VALID)
 				throw std::runtime_error(std::string("Invalid mana cost: ") + std::string(x));
+		}
+		static status parse(const char *begin, const char *end, cost &res);
+		static status parse(const json_string &x, cost &res);
+		static size_t parse(const json_string *x, size_t n, cost *res, status *statuses);
+		int white() const { return lane(WHITE); }
+		int halfwhite() const { return lane(HALFWHITE); }
+		int twowhite() const { return lane(TWOWHITE); }
+		int whiteblue() const { return lane(WHITEBLUE); }
+		int whiteblack() const { return lane(WHITEBLACK); }
+		int whitered() const { return lane(WHITERED); }
+		int whitegreen() const { return lane(WHITEGREEN); }
+		int whitephyrexian() const { return lane(WHITEPHYREXIAN); }
+		int blue() const { return lane(BLUE); }
+		int halfblue() const { return lane(HALFBLUE); }
+		int twoblue() const { return lane(TWOBLUE); }
+		int blueblack() const { return lane(BLUEBLACK); }
+		int bluered() const { return lane(BLUERED); }
+		int bluegreen() const { return lane(BLUEGREEN); }
+		int bluephyrexian() const { return lane(BLUEPHYREXIAN); }
+		int black() const { return lane(BLACK); }
+		int halfblack() const { return lane(HALFBLACK); }
+		int twoblack() const { return lane(TWOBLACK); }
+		int blackred() const { return lane(BLACKRED); }
+		int blackgreen() const { return lane(BLACKGREEN); }
+		int blackphyrexian() const { return lane(BLACKPHYREXIAN); }
+		int red() const { return lane(RED); }
+		int halfred() const { return lane(HALFRED); }
+		int twored() const { return lane(TWORED); }
+		int redgreen() const { return lane(REDGREEN); }
+		int redphyrexian() const { return lane(REDPHYREXIAN); }
+		int green() const { return lane(GREEN); }
+		int halfgreen() const { return lane(HALFGREEN); }
+		int twogreen() const { return lane(TWOGREEN); }
+		int greenphyrexian() const { return lane(GREENPHYREXIAN); }
+		int colorless() const { return lane(COLORLESS); }
+		int x() const { return lane(X); }
+		int y() const { return lane(Y); }
+		int z() const { return lane(Z); }
+		bool exists() const { return _words[4] & EXISTS; }
+		bool tap() const { return _words[4] & TAP; }
+		bool untap() const { return _words[4] & UNTAP; }
+		int generic() const { return (_words[4] >> 32) & 0x7fffffff; }
+		cost &operator+=(const cost &x) {
+			uint64_t overflow = 0;
+			for(int i = 0; i < 4; ++i) {
+				_words[i] += x._words[i];
+				overflow |= _words[i] & guard;
 			}
+			const uint64_t flags = (_words[4] | x._words[4]) & flag_mask;
+			_words[4] = ((_words[4] & ~flag_mask) + (x._words[4] & ~flag_mask)) | flags;
+			overflow |= _words[4] & last_guard;
+			if(overflow)
+				overflow_error();
+			return *this;
+		}
+		cost &operator-=(const cost &x) {
+			uint64_t borrow = 0;
+			for(int i = 0; i < 4; ++i) {
+				_words[i] = (_words[i] | guard) - x._words[i];
+				borrow |= ~_words[i] & guard;
+				_words[i] &= ~guard;
+			}
+			const uint64_t flags = _words[4] & flag_mask;
+			_words[4] = ((_words[4] & ~flag_mask) | last_guard) - (x._words[4] & ~flag_mask);
+			borrow |= ~_words[4] & last_guard;
+			_words[4] = (_words[4] & ~last_guard) | flags;
+			if(borrow)
+				overflow_error();
+			return *this;
+		}
+		bool covers(const cost &x) const {
+			uint64_t borrow = 0;
+			for(int i = 0; i < 4; ++i)
+				borrow |= ~((_words[i] | guard) - x._words[i]) & guard;
+			borrow |= ~(((_words[4] & ~flag_mask) | last_guard) - (x._words[4] & ~flag_mask)) & last_guard;
+			return !borrow;
+		}
+		bool operator==(const cost &x) const {
+			return !((_words[0] ^ x._words[0]) | (_words[1] ^ x._words[1]) | (_words[2] ^ x._words[2]) |
+			         (_words[3] ^ x._words[3]) | (_words[4] ^ x._words[4]));
+		}
+		bool operator!=(const cost &x) const { return !(*this == x); }
+		size_t hash() const {
+			static const uint64_t k0 = 0xa0761d6478bd642fULL, k1 = 0xe7037ed1a0b428dbULL;
+			uint64_t h = json_hash_mix(_words[0] ^ k0, _words[1] ^ k1);
+			h = json_hash_mix(_words[2] ^ h, _words[3] ^ k1);
+			return json_hash_mix(_words[4] ^ h, k0);
 		}
-		int white() const { return _white; }
-		int halfwhite() const { return _halfwhite; }
-		int twowhite() const { return _2white; }
-		int whiteblue() const { return _whiteblue; }
-		int whiteblack() const { return _whiteblack; }
-		int whitered() const { return _whitered; }
-		int whitegreen() const { return _whitegreen; }
-		int whitephyrexian() const { return _whitephyrexian; }
-		int blue() const { return _blue; }
-		int halfblue() const { return _halfblue; }
-		int twoblue() const { return _2blue; }
-		int blueblack() const { return _blueblack; }
-		int bluered() const { return _bluered; }
-		int bluegreen() const { return _bluegreen; }
-		int bluephyrexian() const { return _bluephyrexian; }
-		int black() const { return _black; }
-		int halfblack() const { return _halfblack; }
-		int twoblack() const { return _2black; }
-		int blackred() const { return _blackred; }
-		int blackgreen() const { return _blackgreen; }
-		int blackphyrexian() const { return _blackphyrexian; }
-		int red() const { return _red; }
-		int halfred() const { return _halfred; }
-		int twored() const { return _2red; }
-		int redgreen() const { return _redgreen; }
-		int redphyrexian() const { return _redphyrexian; }
-		int green() const { return _green; }
-		int halfgreen() const { return _halfgreen; }
-		int twogreen() const { return _2green; }
-		int greenphyrexian() const { return _greenphyrexian; }
-		int colorless() const { return _colorless; }
-		int x() const { return _x; }
-		int y() const { return _y; }
-		int z() const { return _z; }
-		bool exists() const { return _exists; }
-		bool tap() const { return _tap; }
-		bool untap() const { return _untap; }
-		int generic() const { return _generic; }
-		cost &operator+=(const cost &x);
-		bool operator==(const cost &x) const;
 	private:
-		void parse_error();
-		void parse_next(json_string::const_iterator str, json_string::const_iterator end);
-		void parse(json_string::const_iterator str, json_string::const_iterator end);
-
-		unsigned int _white:6,
-		             _2white:6,
-		             _whiteblue:6,
-		             _whiteblack:6,
-		             _whitered:6,
-		             _whitegreen:6,
-		             _whitephyrexian:6,
-		             _blue:6,
-		             _2blue:6,
-		             _bluewhite:6,
-		             _blueblack:6,
-		             _bluered:6,
-		             _bluegreen:6,
-		             _bluephyrexian:6,
-		             _black:6,
-		             _2black:6,
-		             _blackred:6,
-		             _blackgreen:6,
-		             _blackphyrexian:6,
-		             _red:6,
-		             _2red:6,
-		             _redgreen:6,
-		             _redphyrexian:6,
-		             _green:6,
-		             _2green:6,
-		             _greenphyrexian:6,
-		             _colorless:6,
-		             _x:2,
-		             _y:2,
-		             _z:2,
-		             _halfwhite:1,
-		             _halfblue:1,
-		             _halfblack:1,
-		             _halfred:1,
-		             _halfgreen:1,
-		             _exists:1,
-		             _tap:1,
-		             _untap:1;
-		unsigned int _generic;
+		static const uint64_t guard = 0x8080808080808080ULL;
+		static const uint64_t last_guard = 0x8000000000008080ULL;
+		static const uint64_t EXISTS = 1 << 16, TAP = 2 << 16, UNTAP = 4 << 16;
+		static const uint64_t flag_mask = EXISTS | TAP | UNTAP;
+
+		int lane(lane_t i) const { return (_words[i >> 3] >> (i & 7) * 8) & 0x7f; }
+		void overflow_error() const;
+		template <class Iterator>
+		static status parse_symbols(Iterator str, Iterator end, cost &res);
+
+		uint64_t _words[5];
+	};
+
+	enum color_t {WHITE = 1, BLUE = 2, BLACK = 4, RED = 8, GREEN = 16, COLORLESS = 32};
+	enum card_type_t {ARTIFACT = 1, CREATURE = 2, ENCHANTMENT = 4, INSTANT = 8, LAND = 16, PLANESWALKER = 32, SORCERY = 64,
+	                  TRIBAL = 128, CONSPIRACY = 256, PHENOMENON = 512, PLANE = 1024, SCHEME = 2048, VANGUARD = 4096};
+	enum supertype_t {BASIC = 1, LEGENDARY = 2, SNOW = 4, WORLD = 8, ONGOING = 16};
+	enum stat_t {HAS_POWER = 1, POWER_STAR = 2, HAS_TOUGHNESS = 4, TOUGHNESS_STAR = 8, INVALID_COST = 16};
+
+	struct mana_ability {
+		uint32_t first;
+		uint16_t count;
+		uint8_t colors;
+		uint8_t amount;
+	};
+
+	class card;
+	class card_set;
+
+	template <class T>
+	class column {
+	public:
+		column() : _data(nullptr), _size(0) { }
+		const T *data() const { return _data; }
+		size_t size() const { return _size; }
+		const T &operator[](size_t i) const { return _data[i]; }
+		void assign(std::vector<T> &&values) {
+			_values = std::move(values);
+			_data = _values.data();
+			_size = _values.size();
+		}
+		void view(const T *data, size_t size) {
+			_values.clear();
+			_data = data;
+			_size = size;
+		}
+	private:
+		std::vector<T> _values;
+		const T *_data;
+		size_t _size;
+	};
+
+	class card_table {
+	public:
+		size_t size() const { return _objects.size(); }
+		const uint32_t *cmc() const { return _cmc.data(); }
+		const uint8_t *colors() const { return _colors.data(); }
+		const uint16_t *types() const { return _types.data(); }
+		const uint8_t *supertypes() const { return _supertypes.data(); }
+		const uint32_t *cost_index() const { return _cost_index.data(); }
+		const cost *costs() const { return _costs.data(); }
+		size_t cost_count() const { return _costs.size(); }
+		const int8_t *power() const { return _power.data(); }
+		const int8_t *toughness() const { return _toughness.data(); }
+		const uint8_t *stats() const { return _stats.data(); }
+		const uint32_t *mana_index() const { return _mana_index.data(); }
+		const mana_ability *mana_abilities() const { return _mana_abilities.data(); }
+		const cost *mana_options() const { return _mana_options.data(); }
+
+		friend class card_database;
+		friend class card;
+		friend class card_set;
+	private:
+		column<uint64_t> _objects;
+		column<uint32_t> _set_first;
+		column<uint32_t> _cmc;
+		column<uint8_t> _colors;
+		column<uint16_t> _types;
+		column<uint8_t> _supertypes;
+		column<uint32_t> _cost_index;
+		column<cost> _costs;
+		column<int8_t> _power;
+		column<int8_t> _toughness;
+		column<uint8_t> _stats;
+		column<uint32_t> _mana_index;
+		column<mana_ability> _mana_abilities;
+		column<cost> _mana_options;
 	};
 
 	class card {
 	public:
-		json_string id() const { return _card["id"]; }
-		json_string layout() const { return _card["layout"]; }
-		json_string name() const { return _card["name"]; }
-		json_array names() const { return _card["names"]; }
+		uint32_t index() const { return _index; }
+		json_string id() const { return _card[_db->_fields.id]; }
+		json_string layout() const { return _card[_db->_fields.layout]; }
+		json_string name() const { return _card[_db->_fields.name]; }
+		json_tape_array names() const { return _card[_db->_fields.names]; }
 		cost mana_cost() const {
-			return cost(_card.has_key("manaCost") ? json_string(_card["manaCost"]) : json_string("", 0));
+			if(_db->_table._stats[_index] & INVALID_COST)
+				return cost(string_or_empty(_db->_fields.mana_cost));
+			return _db->_table._costs[_db->_table._cost_index[_index]];
 		}
-		int cmc() const { return _card.has_key("cmc") ? (int)json_number(_card["cmc"]) : 0; }
-		json_array colors() const { return _card["colors"]; }
-		json_array color_identity() const { return _card["colorIdentity"]; }
-		json_string type() const { return _card["type"]; }
-		json_array supertypes() const { return _card["supertypes"]; }
-		json_array types() const { return _card["types"]; }
-		json_array subtypes() const { return _card["subtypes"]; }
-		json_string rarity() const { return _card["rarity"]; }
-		json_string text() const { return _card.has_key("text") ? json_string(_card["text"]) : json_string("", 0); }
-		json_string flavor() const { return _card["flavor"]; }
-		json_string artist() const { return _card["artist"]; }
-		json_string number() const { return _card["number"]; }
-		json_string power() const { return _card.has_key("power") ? json_string(_card["power"]) : json_string("", 0); }
-		json_string toughness() const { return _card.has_key("toughness") ? json_string(_card["toughness"]) : json_string("", 0); }
-		int loyalty() const { return _card.has_key("loyalty") ? (int)json_number(_card["loyalty"]) : 0; }
-		int multiverse_id() const { return _card.has_key("multiverseid") ? (int)json_number(_card["multiverseid"]) : 0; }
+		int cmc() const { return _db->_table._cmc[_index]; }
+		json_tape_array colors() const { return _card[_db->_fields.colors]; }
+		json_tape_array color_identity() const { return _card[_db->_fields.color_identity]; }
+		json_string type() const { return _card[_db->_fields.type]; }
+		json_tape_array supertypes() const { return _card[_db->_fields.supertypes]; }
+		json_tape_array types() const { return _card[_db->_fields.types]; }
+		json_tape_array subtypes() const { return _card[_db->_fields.subtypes]; }
+		json_string rarity() const { return _card[_db->_fields.rarity]; }
+		json_string text() const { return string_or_empty(_db->_fields.text); }
+		json_string flavor() const { return _card[_db->_fields.flavor]; }
+		json_string artist() const { return _card[_db->_fields.artist]; }
+		json_string number() const { return _card[_db->_fields.number]; }
+		json_string power() const { return string_or_empty(_db->_fields.power); }
+		json_string toughness() const { return string_or_empty(_db->_fields.toughness); }
+		int loyalty() const { return int_or_zero(_db->_fields.loyalty); }
+		int multiverse_id() const { return int_or_zero(_db->_fields.multiverse_id); }
+		const mana_ability &mana() const { return _db->_table._mana_abilities[_db->_table._mana_index[_index]]; }
+		const card_database &database() const { return *_db; }
 
 		friend class array_collection<card>;
+		friend class card_database;
 	private:
-		card(const json_object &x) : _card(x) { }
+		card(const json_tape_object &x, const card_database *db, uint32_t index) : _card(x), _db(db), _index(index) { }
+		json_string string_or_empty(json_atom key) const {
+			json_tape_value x = _card[key];
+			return x.is_null() ? json_string("", 0) : json_string(x);
+		}
+		int int_or_zero(json_atom key) const {
+			json_tape_value x = _card[key];
+			return x.is_null() ? 0 : (int)json_number(x).integer();
+		}
 
-		json_object _card;
+		json_tape_object _card;
+		const card_database *_db;
+		uint32_t _index;
 	};
 
 	class card_set {
 	public:
-		json_string name() const { return _set["name"]; }
-		json_string code() const { return _set["code"]; }
+		json_string name() const { return _set[_db->_fields.name]; }
+		json_string code() const { return _set[_db->_fields.code]; }
 		json_string gatherer_code() const {
-			return _set.has_key("gathererCode") ? _set["gathererCode"] : _set["code"];
+			return _set.has_key(_db->_fields.gatherer_code) ? _set[_db->_fields.gatherer_code] : _set[_db->_fields.code];
 		}
-		json_string release_date() const { return _set["releaseDate"]; }
-		json_string border() const { return _set["border"]; }
-		json_string type() const { return _set.has_key("type") ?  json_string(_set["type"]) : json_string("", 0); }
-		json_string block() const { return _set["block"]; }
-		bool online_only() const { return json_boolean(_set["onlineOnly"]); }
-		array_collection<card> cards() const { return array_collection<card>(_set["cards"]); }
+		json_string release_date() const { return _set[_db->_fields.release_date]; }
+		json_string border() const { return _set[_db->_fields.border]; }
+		json_string type() const { return _set.has_key(_db->_fields.type) ? json_string(_set[_db->_fields.type]) : json_string("", 0); }
+		json_string block() const { return _set[_db->_fields.block]; }
+		bool online_only() const { return json_boolean(_set[_db->_fields.online_only]); }
+		array_collection<card> cards() const { return array_collection<card>(_set[_db->_fields.cards], _db, _db->_table._set_first[_index]); }
 		friend class card_database;
 		friend class object_collection<card_set>;
 	private:
-		card_set(const json_object &x) : _set(x) { }
+		card_set(const json_tape_object &x, const card_database *db, uint32_t index) : _set(x), _db(db), _index(index) { }
+
+		const json_tape_object _set;
+		const card_database *_db;
+		uint32_t _index;
+	};
 
-		const json_object _set;
+	struct load_profile {
+		double map, parse, cards, costs, mana, names;
+		size_t distinct_costs;
 	};
 
 	class deck {
@@ -259,6 +368,13 @@ public:
 		};
 		const std::vector<deck_entry> &cards() const { return _deck; }
 		const std::vector<deck_entry> &sideboard() const { return _sideboard; }
+		const card_database &database() const { return _parent; }
+		uint64_t hash() const {
+			uint64_t res = 0;
+			for(const auto &entry: _deck)
+				res = json_hash_mix(res ^ entry.entry.index(), entry.count + 0xe7037ed1a0b428dbULL);
+			return res;
+		}
 	private:
 		deck(card_database *parent, const std::string &str) : _parent(*parent), _str(str), _name("", 0) {
 			init();
@@ -275,12 +391,22 @@ public:
 	};
 
 	card_database(const char *filename);
-	object_collection<card_set> sets() const { return object_collection<card_set>(_sets); }
+	object_collection<card_set> sets() const { return object_collection<card_set>(_sets.root(), this); }
+	const card_table &table() const { return _table; }
+	const load_profile &profile() const { return _profile; }
+	card get_card(uint32_t index) const { return card(_sets.value(_table._objects[index]), this, index); }
 	card find_card(const json_string &name) {
-		auto res = _cards.find(name);
-		if(res == _cards.end())
-			throw std::runtime_error(std::string("Card not found: ") + std::string(name));
-		return res->second;
+		const uint64_t hash = name.hash();
+		for(size_t i = hash & _name_mask;; i = (i + 1) & _name_mask) {
+			const name_slot &slot = _names[i];
+			if(!slot.card)
+				throw std::runtime_error(std::string("Card not found: ") + std::string(name));
+			if(slot.hash == hash) {
+				card res = get_card(slot.card - 1);
+				if(res.name() == name)
+					return res;
+			}
+		}
 	}
 	card find_card(const char *name) {
 		return find_card(json_string(name, strlen(name)));
@@ -288,15 +414,27 @@ public:
 	deck make_deck(std::string str) {
 		return deck(this, str);
 	}
+	void save(const char *filename) const;
 private:
-	static mapping load(const char *filename);
-	static json_document parse(mapping &data) {
-		auto str = (char *)data.data();
-		return json_parse(str, str+data.size());
-	}
+	struct name_slot {
+		uint64_t hash;
+		uint64_t card;
+	};
+	static mapping load(const char *filename, load_profile &profile);
+	static json_tape parse(mapping &data, load_profile &profile);
+	void index_cards();
+	void view_cards();
+	void index_mana();
+	void view_mana();
+	void index_names();
+	load_profile _profile;
 	mapping _mapping;
-	json_document _sets;
-	std::unordered_map<json_string, card> _cards;
+	json_tape _sets;
+	fields _fields;
+	card_table _table;
+	std::vector<name_slot> _name_table;
+	const name_slot *_names;
+	size_t _name_mask;
 };
 
 std::ostream &operator<<(std::ostream &out, const card_database::cost &x);
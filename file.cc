@@ -37,3 +37,17 @@ std::string file::contents() {
 	res.resize(r);
 	return res;
 }
+
+void file::write(const void *data, size_t size) {
+	auto str = (const char *)data;
+	while(size) {
+		ssize_t r = ::write(_fd, str, size);
+		if(r < 0) {
+			if(errno == EINTR)
+				continue;
+			throw std::runtime_error(strerror(errno));
+		}
+		str += r;
+		size -= r;
+	}
+}
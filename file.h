@@ -30,6 +30,10 @@ public:
 			_flags |= O_WRONLY;
 			return *this;
 		}
+		options &truncate() {
+			_flags |= O_TRUNC;
+			return *this;
+		}
 		file open() {
 			return file(_path, _flags, _mode);
 		}
@@ -41,6 +45,7 @@ public:
 	int fd() const { return _fd; }
 	off_t size() const;
 	std::string contents();
+	void write(const void *data, size_t size);
 private:
 	int _fd;
 };
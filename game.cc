@@ -1,20 +1,26 @@
 #include "game.h"
+#include <algorithm>
+#include <stdexcept>
 
-card::card(const card_database::card &c) : card_database::card(c) {
-	if(types().contains("Land")) {
-		for(const json_string &subtype: subtypes()) {
-			if(subtype == "Plains")
-				_mana.emplace_back("{W}");
-			else if(subtype == "Island")
-				_mana.emplace_back("{U}");
-			else if(subtype == "Swamp")
-				_mana.emplace_back("{B}");
-			else if(subtype == "Mountain")
-				_mana.emplace_back("{R}");
-			else if(subtype == "Forest")
-				_mana.emplace_back("{G}");
-		}
+int card::mana_option(unsigned color) const {
+	const card_database::cost *options = database().table().mana_options() + _mana->first;
+	for(int i = 0; i < _mana->count; ++i) {
+		const auto &mana = options[i];
+		if((color == card_database::WHITE && mana.white()) ||
+		   (color == card_database::BLUE && mana.blue()) ||
+		   (color == card_database::BLACK && mana.black()) ||
+		   (color == card_database::RED && mana.red()) ||
+		   (color == card_database::GREEN && mana.green()) ||
+		   (color == card_database::COLORLESS && mana.colorless()))
+			return i;
 	}
+	return -1;
+}
+
+const card_database::cost &card::mana(int n) const {
+	if(n < 0 || n >= _mana->count)
+		throw std::out_of_range("No such mana ability");
+	return database().table().mana_options()[_mana->first + n];
 }
 
 const card_database::cost &player::mana_pool() const {
@@ -25,40 +31,599 @@ void player::add_mana(const card_database::cost &mana) {
 	_mana_pool += mana;
 }
 
+void player::spend_mana(const card_database::cost &mana) {
+	_mana_pool -= mana;
+}
+
 void player::reset_mana() {
 	_mana_pool = card_database::cost();
 }
 
-permanent::permanent(const card &c) : card(c) {
-	_controller = nullptr;
-	_tapped = false;
+bool permanent::valid() const {
+	return _game && _game->contains(*this);
+}
+
+const card &permanent::card() const {
+	return _game->_details[_game->dense(*this)];
+}
+
+player &permanent::controller() const {
+	return *_game->_players[_game->_controllers[_game->dense(*this)]];
+}
+
+bool permanent::tapped() const {
+	return _game->tapped(_game->dense(*this));
 }
 
 void permanent::tap(int n) {
-	if(!_tapped) {
-		_tapped = true;
-		_controller->add_mana(_mana.at(n));
-	}
+	_game->tap(_game->dense(*this), n);
+}
+
+static void game_assign(std::vector<uint64_t> &bits, size_t i, bool value) {
+	const uint64_t mask = 1ULL << (i & 63);
+	bits[i >> 6] = value ? bits[i >> 6] | mask : bits[i >> 6] & ~mask;
+}
+
+static bool game_test(const std::vector<uint64_t> &bits, size_t i) {
+	return bits[i >> 6] >> (i & 63) & 1;
 }
 
 void permanent::untap() {
-	_tapped = false;
+	const size_t i = _game->dense(*this);
+	if(_game->tapped(i)) {
+		_game->record(game::change::UNTAP, _slot);
+		game_assign(_game->_tapped, i, false);
+	}
+}
+
+game::selection &game::selection::controller(const player &player) {
+	const int controller = _game->player_index(player);
+	if(controller < 0) {
+		_none = true;
+		return *this;
+	}
+	return term(_game->_controlled[controller], false);
+}
+
+game::selection &game::selection::term(const std::vector<uint64_t> &bits, bool negate) {
+	if(_n == sizeof(_terms) / sizeof(*_terms))
+		throw std::length_error("Too many selection terms");
+	_terms[_n] = bits.data();
+	_negate[_n++] = negate ? ~0ULL : 0;
+	return *this;
+}
+
+uint64_t game::selection::word(size_t w) const {
+	const size_t size = _game->size();
+	if(_none || w * 64 >= size)
+		return 0;
+	uint64_t res = size - w * 64 >= 64 ? ~0ULL : (1ULL << (size - w * 64)) - 1;
+	for(size_t i = 0; i < _n; ++i)
+		res &= _terms[i][w] ^ _negate[i];
+	return res;
+}
+
+size_t game::selection::count() const {
+	size_t res = 0;
+	for(size_t w = 0; w * 64 < _game->size(); ++w)
+		res += __builtin_popcountll(word(w));
+	return res;
+}
+
+bool game::selection::empty() const {
+	for(size_t w = 0; w * 64 < _game->size(); ++w) {
+		if(word(w))
+			return false;
+	}
+	return true;
+}
+
+static const card_database::cost &game_mana(unsigned color) {
+	static const card_database::cost mana[6] = {
+		card_database::cost("{W}"), card_database::cost("{U}"), card_database::cost("{B}"),
+		card_database::cost("{R}"), card_database::cost("{G}"), card_database::cost("{C}")
+	};
+	return mana[__builtin_ctz(color)];
+}
+
+template <class Fn>
+void game::each_bitset(Fn &&fn) {
+	fn(_tapped);
+	fn(_sources);
+	for(auto &bits: _controlled)
+		fn(bits);
+	for(auto &bits: _types)
+		fn(bits);
+	for(auto &bits: _produces)
+		fn(bits);
 }
 
 player *&game::add(player &player) {
+	if(_players.size() > 255)
+		throw std::length_error("Too many players");
+	_controlled.emplace_back(_words, 0);
 	_players.push_back(&player);
 	return _players.back();
 }
 
-permanent &game::add(player &player, permanent &&permanent) {
-	_battlefield.push_back(std::move(permanent));
-	auto &res = _battlefield.back();
-	res._controller = &player;
-	return res;
+int game::player_index(const player &player) const {
+	for(size_t i = 0; i < _players.size(); ++i) {
+		if(_players[i] == &player)
+			return i;
+	}
+	return -1;
+}
+
+permanent game::add(player &player, const card &card, bool tapped) {
+	const int controller = player_index(player);
+	if(controller < 0)
+		throw std::invalid_argument("Player is not in the game");
+	uint32_t id;
+	if(_free.empty()) {
+		id = _slots.size();
+		_slots.push_back(slot{0, 0, 0});
+	} else {
+		id = _free.back();
+		_free.pop_back();
+	}
+	insert(id, card, controller, tapped);
+	record(change::ADD, id);
+	return permanent(this, id, _slots[id].generation);
 }
 
-void game::remove(permanent &p) {
-	auto it = _battlefield.begin();
-	it += &p - &*it;
-	_battlefield.erase(it);
+void game::insert(uint32_t id, const card &card, int controller, bool tapped) {
+	const size_t i = _ids.size();
+	if(i == _words * 64) {
+		++_words;
+		each_bitset([](std::vector<uint64_t> &bits) {
+			bits.push_back(0);
+		});
+	}
+	const unsigned types = card.database().table().types()[card.index()];
+	for(int type = 0; type < 13; ++type)
+		game_assign(_types[type], i, types >> type & 1);
+	for(int color = 0; color < 6; ++color)
+		game_assign(_produces[color], i, card.mana_colors() >> color & 1);
+	game_assign(_tapped, i, tapped);
+	game_assign(_sources, i, card.mana_colors());
+	game_assign(_controlled[controller], i, true);
+	_slots[id].dense = i;
+	_ids.push_back(id);
+	_cards.push_back(card.index());
+	_controllers.push_back(controller);
+	_colors.push_back(card.mana_colors());
+	_amounts.push_back(card.mana_amount());
+	_details.push_back(card);
+}
+
+bool game::contains(permanent p) const {
+	return p._game == this && p._slot < _slots.size() && _slots[p._slot].generation == p._generation;
+}
+
+uint32_t game::dense(permanent p) const {
+	if(!contains(p))
+		throw std::out_of_range("Permanent is no longer on the battlefield");
+	return _slots[p._slot].dense;
+}
+
+void game::remove(permanent p) {
+	const uint32_t i = dense(p);
+	if(!_marks.empty()) {
+		_removed.push_back(_details[i]);
+		record(change::REMOVE, p._slot, i | (uint64_t)_controllers[i] << 32 | (uint64_t)tapped(i) << 40, p._generation);
+	}
+	erase(i);
+	retire(p._slot);
+}
+
+void game::erase(size_t i) {
+	const size_t last = _ids.size() - 1;
+	each_bitset([i, last](std::vector<uint64_t> &bits) {
+		game_assign(bits, i, game_test(bits, last));
+		game_assign(bits, last, false);
+	});
+	if(i != last) {
+		_ids[i] = _ids[last];
+		_cards[i] = _cards[last];
+		_controllers[i] = _controllers[last];
+		_colors[i] = _colors[last];
+		_amounts[i] = _amounts[last];
+		_details[i] = std::move(_details[last]);
+		_slots[_ids[i]].dense = i;
+	}
+	_ids.pop_back();
+	_cards.pop_back();
+	_controllers.pop_back();
+	_colors.pop_back();
+	_amounts.pop_back();
+	_details.pop_back();
+}
+
+void game::swap(size_t i, size_t j) {
+	each_bitset([i, j](std::vector<uint64_t> &bits) {
+		const bool bit = game_test(bits, i);
+		game_assign(bits, i, game_test(bits, j));
+		game_assign(bits, j, bit);
+	});
+	std::swap(_ids[i], _ids[j]);
+	std::swap(_cards[i], _cards[j]);
+	std::swap(_controllers[i], _controllers[j]);
+	std::swap(_colors[i], _colors[j]);
+	std::swap(_amounts[i], _amounts[j]);
+	std::swap(_details[i], _details[j]);
+	_slots[_ids[i]].dense = i;
+	_slots[_ids[j]].dense = j;
+}
+
+permanent game::get_permanent(size_t i) {
+	const uint32_t id = _ids.at(i);
+	return permanent(this, id, _slots[id].generation);
+}
+
+void game::clear() {
+	for(uint32_t id: _ids)
+		retire(id);
+	_ids.clear();
+	_cards.clear();
+	_controllers.clear();
+	_colors.clear();
+	_amounts.clear();
+	_details.clear();
+	each_bitset([](std::vector<uint64_t> &bits) {
+		std::fill(bits.begin(), bits.end(), 0);
+	});
+	_changes.clear();
+	_marks.clear();
+	_pools.clear();
+	_removed.clear();
+}
+
+void game::tap(size_t i, int n) {
+	if(!tapped(i)) {
+		_players[_controllers[i]]->add_mana(_details[i].mana(n));
+		game_assign(_tapped, i, true);
+		record(change::TAP, _ids[i]);
+	}
+}
+
+void game::untap(const player &player) {
+	const int controller = player_index(player);
+	if(controller < 0)
+		return;
+	const auto &controlled = _controlled[controller];
+	for(size_t w = 0; w < _words; ++w) {
+		const uint64_t tapped = _tapped[w];
+		if(tapped & controlled[w]) {
+			record(change::UNTAP_WORD, w, tapped);
+			_tapped[w] = tapped & ~controlled[w];
+		}
+	}
+}
+
+size_t game::checkpoint() {
+	_marks.push_back(mark{_changes.size(), _pools.size()});
+	for(const player *p: _players)
+		_pools.push_back(p->mana_pool());
+	return _marks.size() - 1;
+}
+
+void game::undo(const change &c) {
+	switch(c.kind) {
+	case change::TAP:
+		game_assign(_tapped, _slots[c.target].dense, false);
+		break;
+	case change::UNTAP:
+		game_assign(_tapped, _slots[c.target].dense, true);
+		break;
+	case change::UNTAP_WORD:
+		_tapped[c.target] = c.value;
+		break;
+	case change::ADD:
+		erase(_slots[c.target].dense);
+		retire(c.target);
+		break;
+	case change::REMOVE:
+		_free.pop_back();
+		_slots[c.target].generation = c.generation;
+		insert(c.target, _removed.back(), c.value >> 32 & 0xff, c.value >> 40 & 1);
+		_removed.pop_back();
+		if((uint32_t)c.value != _ids.size() - 1)
+			swap((uint32_t)c.value, _ids.size() - 1);
+		break;
+	}
+}
+
+void game::rollback(size_t m) {
+	if(m >= _marks.size())
+		throw std::out_of_range("No such checkpoint");
+	const mark saved = _marks[m];
+	while(_changes.size() > saved.changes) {
+		undo(_changes.back());
+		_changes.pop_back();
+	}
+	const size_t pools = (m + 1 < _marks.size() ? _marks[m + 1].pools : _pools.size()) - saved.pools;
+	for(size_t i = 0; i < pools && i < _players.size(); ++i) {
+		_players[i]->reset_mana();
+		_players[i]->add_mana(_pools[saved.pools + i]);
+	}
+	_pools.resize(saved.pools);
+	_marks.resize(m);
+}
+
+void game::commit(size_t m) {
+	if(m >= _marks.size())
+		throw std::out_of_range("No such checkpoint");
+	_pools.resize(_marks[m].pools);
+	_marks.resize(m);
+	if(_marks.empty()) {
+		_changes.clear();
+		_removed.clear();
+	}
+}
+
+template <class Fn>
+void game::each_source(int controller, Fn &&fn) const {
+	if(controller < 0)
+		return;
+	const auto &controlled = _controlled[controller];
+	for(size_t w = 0; w < _words; ++w) {
+		for(uint64_t bits = controlled[w] & ~_tapped[w] & _sources[w]; bits; bits &= bits - 1)
+			fn(w * 64 + __builtin_ctzll(bits));
+	}
+}
+
+static int game_pool_amount(const card_database::cost &pool, int color) {
+	switch(color) {
+	case 0: return pool.white();
+	case 1: return pool.blue();
+	case 2: return pool.black();
+	case 3: return pool.red();
+	case 4: return pool.green();
+	default: return pool.colorless();
+	}
+}
+
+void game::sources(const player &player, int controller) const {
+	_solver.clear();
+	for(int c = 0; c < 6; ++c) {
+		for(int n = game_pool_amount(player.mana_pool(), c); n > 0; --n)
+			_solver.add(1u << c);
+	}
+	each_source(controller, [this](size_t i) {
+		for(int n = 0; n < _amounts[i]; ++n)
+			_solver.add(_colors[i]);
+	});
+}
+
+bool game::can_pay(const player &player, const card_database::cost &cost, int x, int life) const {
+	sources(player, player_index(player));
+	return _solver.can_pay(cost, x, life);
+}
+
+bool game::pay(player &player, const card_database::cost &cost, int x, int life) {
+	const int controller = player_index(player);
+	sources(player, controller);
+	mana_solver::payment payment;
+	if(!_solver.pay(cost, payment, x, life))
+		return false;
+	size_t source = 0;
+	const card_database::cost pool = player.mana_pool();
+	for(int c = 0; c < 6; ++c) {
+		for(int n = game_pool_amount(pool, c); n > 0; --n, ++source) {
+			if(payment.produce[source])
+				player.spend_mana(game_mana(payment.produce[source]));
+		}
+	}
+	each_source(controller, [&](size_t i) {
+		for(int n = 0; n < _amounts[i]; ++n, ++source) {
+			if(!payment.produce[source])
+				continue;
+			if(!tapped(i))
+				tap(i, _details[i].mana_option(payment.produce[source]));
+			player.spend_mana(game_mana(payment.produce[source]));
+		}
+	});
+	return true;
+}
+
+static const unsigned mana_solver_colors[5] = {
+	card_database::WHITE, card_database::BLUE, card_database::BLACK, card_database::RED, card_database::GREEN
+};
+
+static const uint8_t mana_solver_shards[16] = {
+	card_database::WHITE, card_database::BLUE, card_database::BLACK, card_database::RED, card_database::GREEN,
+	card_database::COLORLESS,
+	card_database::WHITE | card_database::BLUE, card_database::WHITE | card_database::BLACK,
+	card_database::WHITE | card_database::RED, card_database::WHITE | card_database::GREEN,
+	card_database::BLUE | card_database::BLACK, card_database::BLUE | card_database::RED,
+	card_database::BLUE | card_database::GREEN, card_database::BLACK | card_database::RED,
+	card_database::BLACK | card_database::GREEN, card_database::RED | card_database::GREEN
+};
+
+void mana_solver::add(unsigned colors) {
+	if(!(colors & 63))
+		return;
+	_sources.push_back(colors & 63);
+	_signature += json_hash_mix((colors & 63) + 1, 0x9e3779b97f4a7c15ULL);
+	_dirty = true;
+}
+
+void mana_solver::clear() {
+	_sources.clear();
+	_signature = 0;
+	_dirty = true;
+}
+
+void mana_solver::update() const {
+	uint16_t subsets[64] = {0};
+	for(uint8_t source: _sources)
+		++subsets[source];
+	for(int bit = 1; bit < 64; bit <<= 1) {
+		for(int base = 0; base < 64; base += 2*bit) {
+			for(int m = base; m < base + bit; ++m)
+				subsets[m + bit] += subsets[m];
+		}
+	}
+	for(int m = 0; m < 64; ++m)
+		_have[m] = _sources.size() - subsets[63 ^ m];
+	_dirty = false;
+}
+
+void mana_solver::decompose(const card_database::cost &cost, int x, requirement &req) {
+	using db = card_database;
+	memset(&req, 0, sizeof(req));
+	req.shards[db::WHITE] = cost.white() + cost.halfwhite();
+	req.shards[db::BLUE] = cost.blue() + cost.halfblue();
+	req.shards[db::BLACK] = cost.black() + cost.halfblack();
+	req.shards[db::RED] = cost.red() + cost.halfred();
+	req.shards[db::GREEN] = cost.green() + cost.halfgreen();
+	req.shards[db::COLORLESS] = cost.colorless();
+	req.shards[db::WHITE | db::BLUE] = cost.whiteblue();
+	req.shards[db::WHITE | db::BLACK] = cost.whiteblack();
+	req.shards[db::WHITE | db::RED] = cost.whitered();
+	req.shards[db::WHITE | db::GREEN] = cost.whitegreen();
+	req.shards[db::BLUE | db::BLACK] = cost.blueblack();
+	req.shards[db::BLUE | db::RED] = cost.bluered();
+	req.shards[db::BLUE | db::GREEN] = cost.bluegreen();
+	req.shards[db::BLACK | db::RED] = cost.blackred();
+	req.shards[db::BLACK | db::GREEN] = cost.blackgreen();
+	req.shards[db::RED | db::GREEN] = cost.redgreen();
+	req.twobrid[0] = cost.twowhite();
+	req.twobrid[1] = cost.twoblue();
+	req.twobrid[2] = cost.twoblack();
+	req.twobrid[3] = cost.twored();
+	req.twobrid[4] = cost.twogreen();
+	req.phyrexian[0] = cost.whitephyrexian();
+	req.phyrexian[1] = cost.bluephyrexian();
+	req.phyrexian[2] = cost.blackphyrexian();
+	req.phyrexian[3] = cost.redphyrexian();
+	req.phyrexian[4] = cost.greenphyrexian();
+	req.generic = cost.generic() + (uint32_t)x * (cost.x() + cost.y() + cost.z());
+}
+
+bool mana_solver::feasible(const requirement &req) const {
+	uint8_t masks[16];
+	uint16_t counts[16];
+	size_t n = 0;
+	uint32_t total = req.generic;
+	unsigned support = 0;
+	for(uint8_t mask: mana_solver_shards) {
+		if(req.shards[mask]) {
+			masks[n] = mask;
+			counts[n] = req.shards[mask];
+			total += counts[n++];
+			support |= mask;
+		}
+	}
+	if(total > _sources.size())
+		return false;
+	for(unsigned u = support; u; u = (u - 1) & support) {
+		uint32_t need = 0;
+		for(size_t i = 0; i < n; ++i) {
+			if(!(masks[i] & ~u))
+				need += counts[i];
+		}
+		if(need > _have[u])
+			return false;
+	}
+	return true;
+}
+
+bool mana_solver::search(requirement &req, int choice, int life) const {
+	while(choice < 10 && !(choice < 5 ? req.twobrid[choice] : req.phyrexian[choice - 5]))
+		++choice;
+	if(choice == 10) {
+		req.life = life;
+		return feasible(req);
+	}
+	const unsigned color = mana_solver_colors[choice % 5];
+	uint16_t &count = choice < 5 ? req.twobrid[choice] : req.phyrexian[choice - 5];
+	const uint16_t n = count;
+	count = 0;
+	for(uint16_t colored = n + 1; colored-- > 0;) {
+		const uint16_t other = n - colored;
+		if(choice >= 5 && other * 2 > life)
+			continue;
+		req.shards[color] += colored;
+		if(choice < 5)
+			req.generic += 2 * other;
+		if(search(req, choice + 1, choice < 5 ? life : life - other * 2))
+			return true;
+		req.shards[color] -= colored;
+		if(choice < 5)
+			req.generic -= 2 * other;
+	}
+	count = n;
+	return false;
+}
+
+bool mana_solver::can_pay(const card_database::cost &cost, int x, int life) const {
+	struct memo {
+		uint64_t signature;
+		card_database::cost cost;
+		int x, life;
+		bool valid, result;
+	};
+	static thread_local memo cache[1024];
+	const size_t slot = json_hash_mix(_signature ^ cost.hash(), ((uint64_t)x << 32 ^ (uint32_t)life) ^ 0xe7037ed1a0b428dbULL) & 1023;
+	memo &entry = cache[slot];
+	if(entry.valid && entry.signature == _signature && entry.cost == cost && entry.x == x && entry.life == life)
+		return entry.result;
+	if(_dirty)
+		update();
+	requirement req;
+	decompose(cost, x, req);
+	entry.signature = _signature;
+	entry.cost = cost;
+	entry.x = x;
+	entry.life = life;
+	entry.valid = true;
+	entry.result = search(req, 0, life);
+	return entry.result;
+}
+
+static bool mana_solver_augment(size_t shard, const std::vector<unsigned> &shards, const std::vector<uint8_t> &sources,
+                                std::vector<int> &match, std::vector<bool> &seen) {
+	for(size_t i = 0; i < sources.size(); ++i) {
+		if(!(sources[i] & shards[shard]) || seen[i])
+			continue;
+		seen[i] = true;
+		if(match[i] < 0 || mana_solver_augment(match[i], shards, sources, match, seen)) {
+			match[i] = shard;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool mana_solver::pay(const card_database::cost &cost, payment &res, int x, int life) const {
+	if(_dirty)
+		update();
+	requirement req;
+	decompose(cost, x, req);
+	if(!search(req, 0, life))
+		return false;
+	std::vector<unsigned> shards;
+	for(uint8_t mask: mana_solver_shards)
+		shards.insert(shards.end(), req.shards[mask], mask);
+	std::vector<int> match(_sources.size(), -1);
+	std::vector<bool> seen;
+	for(size_t i = 0; i < shards.size(); ++i) {
+		seen.assign(_sources.size(), false);
+		if(!mana_solver_augment(i, shards, _sources, match, seen))
+			return false;
+	}
+	res.produce.assign(_sources.size(), 0);
+	res.life = life - req.life;
+	uint32_t generic = req.generic;
+	for(size_t i = 0; i < _sources.size(); ++i) {
+		const unsigned available = match[i] < 0 ? _sources[i] : _sources[i] & shards[match[i]];
+		if(match[i] >= 0)
+			res.produce[i] = available & -available;
+		else if(generic) {
+			res.produce[i] = available & -available;
+			--generic;
+		}
+	}
+	return true;
 }
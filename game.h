@@ -2,43 +2,198 @@
 #define DECKEVAL_GAME_H
 #include "carddb.h"
 #include <vector>
+#include <cstring>
 
 class card : public card_database::card {
 public:
-	card(const card_database::card &c);
+	card(const card_database::card &c) : card_database::card(c), _mana(&c.mana()) { }
+	unsigned mana_colors() const { return _mana->colors; }
+	int mana_amount() const { return _mana->amount; }
+	int mana_option(unsigned color) const;
+	using card_database::card::mana;
+	const card_database::cost &mana(int n) const;
 protected:
-	std::vector<card_database::cost> _mana;
+	const card_database::mana_ability *_mana;
 };
 
 class player {
 public:
 	const card_database::cost &mana_pool() const;
 	void add_mana(const card_database::cost &mana);
+	void spend_mana(const card_database::cost &mana);
 	void reset_mana();
 private:
 	card_database::cost _mana_pool;
 };
 
-class permanent : public card {
+class game;
+
+class permanent {
 public:
-	permanent(const card &c);
+	permanent() : _game(nullptr), _slot(0), _generation(0) { }
+	bool valid() const;
+	uint32_t slot() const { return _slot; }
+	uint32_t generation() const { return _generation; }
+	const class card &card() const;
+	class player &controller() const;
+	bool tapped() const;
 	void tap(int n = 0);
 	void untap();
+	bool operator ==(const permanent &p) const { return _game == p._game && _slot == p._slot && _generation == p._generation; }
+	bool operator !=(const permanent &p) const { return !(*this == p); }
 private:
-	player *_controller;
-	bool _tapped;
+	permanent(game *g, uint32_t slot, uint32_t generation) : _game(g), _slot(slot), _generation(generation) { }
+
+	game *_game;
+	uint32_t _slot;
+	uint32_t _generation;
 
 	friend class game;
 };
 
+class mana_solver {
+public:
+	struct payment {
+		std::vector<unsigned> produce;
+		int life;
+	};
+
+	mana_solver() : _signature(0), _dirty(false) {
+		memset(_have, 0, sizeof(_have));
+	}
+	size_t size() const { return _sources.size(); }
+	void add(unsigned colors);
+	void clear();
+	bool can_pay(const card_database::cost &cost, int x = 0, int life = 0) const;
+	bool pay(const card_database::cost &cost, payment &res, int x = 0, int life = 0) const;
+private:
+	struct requirement {
+		uint16_t shards[64];
+		uint16_t twobrid[5];
+		uint16_t phyrexian[5];
+		uint32_t generic;
+		int life;
+	};
+	static void decompose(const card_database::cost &cost, int x, requirement &req);
+	bool search(requirement &req, int choice, int life) const;
+	bool feasible(const requirement &req) const;
+	void update() const;
+
+	std::vector<uint8_t> _sources;
+	uint64_t _signature;
+	mutable bool _dirty;
+	mutable uint16_t _have[64];
+};
+
 class game {
 public:
+	class selection {
+	public:
+		selection &controller(const player &player);
+		selection &tapped(bool tapped = true) { return term(_game->_tapped, !tapped); }
+		selection &type(card_database::card_type_t type) { return term(_game->_types[__builtin_ctz(type)], false); }
+		selection &produces(card_database::color_t color) { return term(_game->_produces[__builtin_ctz(color)], false); }
+		size_t count() const;
+		bool empty() const;
+		template <class Fn>
+		void each(Fn &&fn) const {
+			const size_t words = (_game->size() + 63) / 64;
+			for(size_t w = 0; w < words; ++w) {
+				for(uint64_t bits = word(w); bits; bits &= bits - 1)
+					fn(_game->get_permanent(w * 64 + __builtin_ctzll(bits)));
+			}
+		}
+
+		friend class game;
+	private:
+		selection(game *g) : _game(g), _n(0), _none(false) { }
+		selection &term(const std::vector<uint64_t> &bits, bool negate);
+		uint64_t word(size_t w) const;
+
+		game *_game;
+		const uint64_t *_terms[8];
+		uint64_t _negate[8];
+		size_t _n;
+		bool _none;
+	};
+
+	game() : _words(0) { }
 	player *&add(player &player);
-	permanent &add(player &player, permanent &&permanent);
-	void remove(permanent &p);
+	permanent add(player &player, const card &card, bool tapped = false);
+	void remove(permanent p);
+	bool contains(permanent p) const;
+	size_t size() const { return _cards.size(); }
+	permanent get_permanent(size_t i);
+	selection select() { return selection(this); }
+	void clear();
+	void untap(const player &player);
+	size_t checkpoint();
+	void rollback(size_t mark);
+	void commit(size_t mark);
+	bool can_pay(const player &player, const card_database::cost &cost, int x = 0, int life = 0) const;
+	bool pay(player &player, const card_database::cost &cost, int x = 0, int life = 0);
 private:
+	struct slot {
+		uint32_t dense;
+		uint32_t generation;
+		uint32_t latest;
+	};
+	struct change {
+		enum kind_t {TAP, UNTAP, UNTAP_WORD, ADD, REMOVE};
+		kind_t kind;
+		uint32_t target;
+		uint32_t generation;
+		uint64_t value;
+	};
+	struct mark {
+		size_t changes;
+		size_t pools;
+	};
+
+	void record(change::kind_t kind, uint32_t target, uint64_t value = 0, uint32_t generation = 0) {
+		if(!_marks.empty())
+			_changes.push_back(change{kind, target, generation, value});
+	}
+	void retire(uint32_t id) {
+		_slots[id].generation = ++_slots[id].latest;
+		_free.push_back(id);
+	}
+	void undo(const change &c);
+	void insert(uint32_t id, const card &card, int controller, bool tapped);
+	void erase(size_t i);
+	void swap(size_t i, size_t j);
+	int player_index(const player &player) const;
+	uint32_t dense(permanent p) const;
+	bool tapped(size_t i) const { return _tapped[i >> 6] >> (i & 63) & 1; }
+	void tap(size_t i, int n);
+	template <class Fn>
+	void each_bitset(Fn &&fn);
+	template <class Fn>
+	void each_source(int controller, Fn &&fn) const;
+	void sources(const player &player, int controller) const;
+
 	std::vector<player *> _players;
-	std::vector<permanent> _battlefield;
+	std::vector<slot> _slots;
+	std::vector<uint32_t> _free;
+	std::vector<uint32_t> _ids;
+	std::vector<uint32_t> _cards;
+	std::vector<uint8_t> _controllers;
+	std::vector<uint8_t> _colors;
+	std::vector<uint8_t> _amounts;
+	std::vector<card> _details;
+	size_t _words;
+	std::vector<uint64_t> _tapped;
+	std::vector<uint64_t> _sources;
+	std::vector<std::vector<uint64_t>> _controlled;
+	std::vector<uint64_t> _types[13];
+	std::vector<uint64_t> _produces[6];
+	std::vector<change> _changes;
+	std::vector<mark> _marks;
+	std::vector<card_database::cost> _pools;
+	std::vector<card> _removed;
+	mutable mana_solver _solver;
+
+	friend class permanent;
 };
 
 #endif
@@ -0,0 +1,364 @@
+#include "goldfish.h"
+#include "rng.h"
+#include "simulation.h"
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+
+namespace {
+
+struct goldfish_plan : simulation_plan {
+	std::vector<uint16_t> land_entries;
+	std::vector<uint16_t> spell_entries;
+	std::vector<uint8_t> groups;
+	std::vector<int> source_group;
+	std::vector<uint32_t> shard_first;
+	std::vector<uint8_t> shard_masks;
+	std::vector<uint16_t> shard_counts;
+	size_t hand;
+
+	goldfish_plan(const card_database::deck &deck, int turns, int hand, bool draw_first);
+};
+
+class goldfish_player {
+public:
+	goldfish_player(const goldfish_plan &plan, uint64_t key) : _plan(plan), _key(key), _colors(0) {
+		_game.add(_player);
+		_library.reserve(plan.library.size());
+		_hand.reserve(plan.library.size());
+	}
+	void play(uint64_t game, std::vector<uint64_t> &cast);
+private:
+	void play_land(int turn, std::vector<uint64_t> &cast);
+	void cast_spells(int turn, std::vector<uint64_t> &cast);
+
+	const goldfish_plan &_plan;
+	uint64_t _key;
+	class game _game;
+	class player _player;
+	std::vector<uint16_t> _library;
+	std::vector<uint16_t> _hand;
+	unsigned _colors;
+};
+
+void goldfish_player::play(uint64_t game, std::vector<uint64_t> &cast) {
+	_game.clear();
+	_colors = 0;
+	_library = _plan.library;
+	philox(_key, game).shuffle(_library.data(), _library.size(), _plan.hand + _plan.turns + _plan.draw_first);
+	size_t top = std::min(_plan.hand, _library.size());
+	_hand.assign(_library.begin(), _library.begin() + top);
+	for(int turn = 0; turn < _plan.turns; ++turn) {
+		_game.untap(_player);
+		_player.reset_mana();
+		if((turn || _plan.draw_first) && top < _library.size())
+			_hand.push_back(_library[top++]);
+		play_land(turn, cast);
+		cast_spells(turn, cast);
+	}
+}
+
+void goldfish_player::play_land(int turn, std::vector<uint64_t> &cast) {
+	const int best = _plan.choose_land(_hand, _colors);
+	if(best < 0)
+		return;
+	const uint16_t entry = _hand[best];
+	_hand[best] = _hand.back();
+	_hand.pop_back();
+	_colors |= _plan.cards[entry].mana_colors();
+	_game.add(_player, _plan.cards[entry]);
+	++cast[entry * _plan.turns + turn];
+}
+
+void goldfish_player::cast_spells(int turn, std::vector<uint64_t> &cast) {
+	_plan.cast_spells(_hand, _game, _player, [&](uint16_t entry) {
+		if(!_game.pay(_player, _plan.costs[entry]))
+			throw std::logic_error("Illegal cast during goldfish");
+		++cast[entry * _plan.turns + turn];
+		if(_plan.cards[entry].mana_colors())
+			_game.add(_player, _plan.cards[entry], _plan.creatures[entry]);
+		_hand.erase(std::find(_hand.begin(), _hand.end(), entry));
+	});
+}
+
+typedef int16_t goldfish_lanes __attribute__((vector_size(32), aligned(2)));
+
+__attribute__((always_inline)) inline uint64_t goldfish_count(const goldfish_lanes &n) {
+	uint64_t res = 0;
+	for(size_t l = 0; l < sizeof(n) / sizeof(n[0]); ++l)
+		res += n[l];
+	return res;
+}
+
+class goldfish_batch {
+public:
+	static const size_t lanes = sizeof(goldfish_lanes) / sizeof(int16_t);
+	static const size_t groups = 63;
+
+	goldfish_batch(const goldfish_plan &plan, uint64_t key) : _plan(plan), _key(key), _hand(plan.cards.size() * lanes), _library(lanes) { }
+	void play(uint64_t first, size_t games, std::vector<uint64_t> &cast);
+private:
+	void play_land(int turn, std::vector<uint64_t> &cast);
+	void cast_spells(int turn, std::vector<uint64_t> &cast);
+	void spend(uint8_t mask, int16_t count, goldfish_lanes &n);
+	void produce(size_t entry, const goldfish_lanes &n);
+	goldfish_lanes &hand(size_t entry) { return *reinterpret_cast<goldfish_lanes *>(&_hand[entry * lanes]); }
+
+	const goldfish_plan &_plan;
+	uint64_t _key;
+	std::vector<int16_t> _hand;
+	std::vector<std::vector<uint16_t>> _library;
+	goldfish_lanes _total[groups];
+	goldfish_lanes _untapped[groups];
+	goldfish_lanes _ready[groups];
+	goldfish_lanes _left[groups];
+	goldfish_lanes _avail;
+	goldfish_lanes _colors;
+};
+
+const size_t goldfish_batch::lanes;
+const size_t goldfish_batch::groups;
+
+__attribute__((always_inline)) inline void goldfish_batch::play(uint64_t first, size_t games, std::vector<uint64_t> &cast) {
+	std::fill(_hand.begin(), _hand.end(), 0);
+	memset(_total, 0, _plan.groups.size() * sizeof(_total[0]));
+	memset(_ready, 0, _plan.groups.size() * sizeof(_ready[0]));
+	_colors = goldfish_lanes{};
+	const size_t size = _plan.library.size();
+	size_t top = std::min(_plan.hand, size);
+	for(size_t l = 0; l < games; ++l) {
+		_library[l] = _plan.library;
+		philox(_key, first + l).shuffle(_library[l].data(), size, _plan.hand + _plan.turns + _plan.draw_first);
+		for(size_t i = 0; i < top; ++i)
+			++_hand[_library[l][i] * lanes + l];
+	}
+	for(int turn = 0; turn < _plan.turns; ++turn) {
+		_avail = goldfish_lanes{};
+		for(size_t g = 0; g < _plan.groups.size(); ++g) {
+			_total[g] += _ready[g];
+			_untapped[g] = _total[g];
+			_ready[g] = goldfish_lanes{};
+			_avail += _total[g];
+		}
+		if((turn || _plan.draw_first) && top < size) {
+			for(size_t l = 0; l < games; ++l)
+				++_hand[_library[l][top] * lanes + l];
+			++top;
+		}
+		play_land(turn, cast);
+		cast_spells(turn, cast);
+	}
+}
+
+__attribute__((always_inline)) inline void goldfish_batch::play_land(int turn, std::vector<uint64_t> &cast) {
+	goldfish_lanes best{}, score{};
+	for(uint16_t entry: _plan.land_entries) {
+		const goldfish_lanes &h = hand(entry);
+		const unsigned produces = _plan.cards[entry].mana_colors();
+		goldfish_lanes s;
+		for(size_t l = 0; l < lanes; ++l)
+			s[l] = h[l] ? 1 + __builtin_popcount(produces & ~_colors[l]) : 0;
+		const goldfish_lanes take = s > score;
+		score = take ? s : score;
+		best = take ? goldfish_lanes{} + (int16_t)entry : best;
+	}
+	for(uint16_t entry: _plan.land_entries) {
+		const goldfish_lanes n = (score != 0) & (best == (int16_t)entry) & 1;
+		const uint64_t played = goldfish_count(n);
+		if(!played)
+			continue;
+		hand(entry) -= n;
+		_colors |= -n & (int16_t)_plan.cards[entry].mana_colors();
+		cast[entry * _plan.turns + turn] += played;
+		produce(entry, n);
+	}
+}
+
+__attribute__((always_inline)) inline void goldfish_batch::cast_spells(int turn, std::vector<uint64_t> &cast) {
+	for(bool again = true; again;) {
+		again = false;
+		for(uint16_t entry: _plan.spell_entries) {
+			goldfish_lanes &h = hand(entry);
+			const int16_t cmc = _plan.cmc[entry];
+			for(;;) {
+				goldfish_lanes n = (h != 0) & (_avail >= cmc) & 1;
+				if(!goldfish_count(n))
+					break;
+				memcpy(_left, _untapped, _plan.groups.size() * sizeof(_left[0]));
+				for(uint32_t i = _plan.shard_first[entry]; i < _plan.shard_first[entry + 1]; ++i)
+					spend(_plan.shard_masks[i], _plan.shard_counts[i], n);
+				const uint64_t casts = goldfish_count(n);
+				if(!casts)
+					break;
+				h -= n;
+				_avail -= n * cmc;
+				for(size_t g = 0; g < _plan.groups.size(); ++g)
+					_untapped[g] = n ? _left[g] : _untapped[g];
+				cast[entry * _plan.turns + turn] += casts;
+				produce(entry, n);
+				again |= _plan.source_group[entry] >= 0 && !_plan.creatures[entry];
+			}
+			if(again)
+				break;
+		}
+	}
+}
+
+__attribute__((always_inline)) inline void goldfish_batch::spend(uint8_t mask, int16_t count, goldfish_lanes &n) {
+	goldfish_lanes need = goldfish_lanes{} + count;
+	for(size_t g = 0; g < _plan.groups.size(); ++g) {
+		if(!(_plan.groups[g] & mask))
+			continue;
+		const goldfish_lanes take = need < _left[g] ? need : _left[g];
+		_left[g] -= take;
+		need -= take;
+	}
+	n &= (need == 0) & 1;
+}
+
+__attribute__((always_inline)) inline void goldfish_batch::produce(size_t entry, const goldfish_lanes &n) {
+	const int group = _plan.source_group[entry];
+	if(group < 0)
+		return;
+	const goldfish_lanes mana = n * (int16_t)_plan.cards[entry].mana_amount();
+	if(_plan.creatures[entry]) {
+		_ready[group] += mana;
+		return;
+	}
+	_total[group] += mana;
+	_untapped[group] += mana;
+	_avail += mana;
+}
+
+__attribute__((always_inline)) inline void goldfish_play_batches(goldfish_batch &batch, uint64_t first, uint64_t games, std::vector<uint64_t> &cast) {
+	for(uint64_t game = first; game < first + games; game += goldfish_batch::lanes)
+		batch.play(game, std::min<uint64_t>(goldfish_batch::lanes, first + games - game), cast);
+}
+
+void default_play_batches(goldfish_batch &batch, uint64_t first, uint64_t games, std::vector<uint64_t> &cast) {
+	goldfish_play_batches(batch, first, games, cast);
+}
+
+#if !defined(__ARM_NEON__) && __SSE2__
+__attribute__((target("avx2"))) void avx2_play_batches(goldfish_batch &batch, uint64_t first, uint64_t games, std::vector<uint64_t> &cast) {
+	goldfish_play_batches(batch, first, games, cast);
+}
+#endif
+
+typedef void (*goldfish_batch_kernel)(goldfish_batch &, uint64_t, uint64_t, std::vector<uint64_t> &);
+
+goldfish_batch_kernel goldfish_select_kernel() {
+#if !defined(__ARM_NEON__) && __SSE2__
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2"))
+		return avx2_play_batches;
+#endif
+	return default_play_batches;
+}
+
+goldfish_plan::goldfish_plan(const card_database::deck &deck, int turns, int hand, bool draw_first) : simulation_plan(deck, turns, draw_first), hand(hand) {
+	using db = card_database;
+	for(size_t e = 0; e < cards.size(); ++e) {
+		const unsigned produces = cards[e].mana_colors() & 63;
+		if(produces && cards[e].mana_amount() && std::find(groups.begin(), groups.end(), produces) == groups.end())
+			groups.push_back(produces);
+	}
+	std::stable_sort(groups.begin(), groups.end(), [](uint8_t a, uint8_t b) {
+		return __builtin_popcount(a & 31) < __builtin_popcount(b & 31);
+	});
+	for(size_t e = 0; e < cards.size(); ++e) {
+		const unsigned produces = cards[e].mana_colors() & 63;
+		const auto group = std::find(groups.begin(), groups.end(), produces);
+		source_group.push_back(produces && cards[e].mana_amount() ? group - groups.begin() : -1);
+		const auto &cost = costs[e];
+		const std::pair<uint8_t, int> shards[] = {
+			{db::WHITE, cost.white() + cost.whitephyrexian() + cost.twowhite()},
+			{db::BLUE, cost.blue() + cost.bluephyrexian() + cost.twoblue()},
+			{db::BLACK, cost.black() + cost.blackphyrexian() + cost.twoblack()},
+			{db::RED, cost.red() + cost.redphyrexian() + cost.twored()},
+			{db::GREEN, cost.green() + cost.greenphyrexian() + cost.twogreen()},
+			{db::COLORLESS, cost.colorless()},
+			{db::WHITE | db::BLUE, cost.whiteblue()}, {db::WHITE | db::BLACK, cost.whiteblack()},
+			{db::WHITE | db::RED, cost.whitered()}, {db::WHITE | db::GREEN, cost.whitegreen()},
+			{db::BLUE | db::BLACK, cost.blueblack()}, {db::BLUE | db::RED, cost.bluered()},
+			{db::BLUE | db::GREEN, cost.bluegreen()}, {db::BLACK | db::RED, cost.blackred()},
+			{db::BLACK | db::GREEN, cost.blackgreen()}, {db::RED | db::GREEN, cost.redgreen()}
+		};
+		int colored = 0;
+		shard_first.push_back(shard_masks.size());
+		for(const auto &shard: shards) {
+			if(!shard.second)
+				continue;
+			shard_masks.push_back(shard.first);
+			shard_counts.push_back(shard.second);
+			colored += shard.second;
+		}
+		if(cmc[e] > colored) {
+			shard_masks.push_back(63);
+			shard_counts.push_back(cmc[e] - colored);
+		}
+		if(lands[e])
+			land_entries.push_back(e);
+		else if(cost.exists())
+			spell_entries.push_back(e);
+	}
+	shard_first.push_back(shard_masks.size());
+	std::stable_sort(spell_entries.begin(), spell_entries.end(), [this](uint16_t a, uint16_t b) {
+		return cmc[a] > cmc[b];
+	});
+}
+
+}
+
+goldfish goldfish::options::run() const {
+	const goldfish_plan plan(*_deck, _turns, _hand, _draw_first);
+
+	static const goldfish_batch_kernel kernel = goldfish_select_kernel();
+	const uint64_t key = json_hash_mix(_seed ^ 0x8ebc6af09c88c6e3ULL, _deck->hash());
+	const unsigned threads = std::max(1u, (unsigned)std::min<uint64_t>(_threads, _games ? _games : 1));
+	const size_t entries = plan.cards.size();
+	std::vector<std::vector<uint64_t>> counts(threads, std::vector<uint64_t>(entries * _turns));
+	std::vector<std::exception_ptr> errors(threads);
+	auto run = [&](unsigned i) {
+		try {
+			const uint64_t first = _games / threads * i + std::min<uint64_t>(i, _games % threads);
+			const uint64_t games = _games / threads + (i < _games % threads);
+			if(_rules == SIMPLE) {
+				goldfish_batch batch(plan, key);
+				kernel(batch, first, games, counts[i]);
+			} else {
+				goldfish_player player(plan, key);
+				for(uint64_t game = first; game < first + games; ++game)
+					player.play(game, counts[i]);
+			}
+		} catch(...) {
+			errors[i] = std::current_exception();
+		}
+	};
+	std::vector<std::thread> workers;
+	for(unsigned i = 1; i < threads; ++i)
+		workers.emplace_back(run, i);
+	run(0);
+	for(auto &worker: workers)
+		worker.join();
+	for(auto &error: errors) {
+		if(error)
+			std::rethrow_exception(error);
+	}
+
+	goldfish res(_games, _turns);
+	for(size_t e = 0; e < entries; ++e) {
+		const auto &entry = _deck->cards()[e];
+		res._cards.emplace_back(entry.entry, entry.count, _turns);
+		auto &stats = res._cards.back();
+		uint64_t cast = 0;
+		for(int turn = 0; turn < _turns; ++turn) {
+			for(unsigned i = 0; i < threads; ++i)
+				stats.cast[turn] += counts[i][e * _turns + turn];
+			cast += stats.cast[turn];
+		}
+		stats.uncast = _games * entry.count - cast;
+	}
+	return res;
+}
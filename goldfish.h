@@ -0,0 +1,86 @@
+#ifndef DECKEVAL_GOLDFISH_H
+#define DECKEVAL_GOLDFISH_H
+#include "game.h"
+#include <thread>
+#include <vector>
+
+class goldfish {
+public:
+	// FULL plays every game through the mana solver. SIMPLE plays 16 games at a time and pays each
+	// shard from the untapped sources with the fewest colors first, so it can miss payments that need
+	// a different assignment, and it pays phyrexian and two-generic hybrid shards with colored mana.
+	enum rules_t {FULL, SIMPLE};
+
+	struct card_stats {
+		card_database::card card;
+		int count;
+		std::vector<uint64_t> cast;
+		uint64_t uncast;
+
+		card_stats(const card_database::card &card, int count, int turns) : card(card), count(count), cast(turns), uncast(0) { }
+	};
+
+	class options {
+	public:
+		options(const card_database::deck &deck) {
+			_deck = &deck;
+			_games = 100000;
+			_turns = 10;
+			_hand = 7;
+			_threads = std::thread::hardware_concurrency();
+			_seed = 0;
+			_draw_first = false;
+			_rules = FULL;
+		}
+		options &games(uint64_t games) {
+			_games = games;
+			return *this;
+		}
+		options &turns(int turns) {
+			_turns = turns;
+			return *this;
+		}
+		options &hand(int hand) {
+			_hand = hand;
+			return *this;
+		}
+		options &threads(unsigned threads) {
+			_threads = threads;
+			return *this;
+		}
+		options &seed(uint64_t seed) {
+			_seed = seed;
+			return *this;
+		}
+		options &draw_first(bool draw_first = true) {
+			_draw_first = draw_first;
+			return *this;
+		}
+		options &rules(rules_t rules) {
+			_rules = rules;
+			return *this;
+		}
+		goldfish run() const;
+	private:
+		const card_database::deck *_deck;
+		uint64_t _games;
+		int _turns;
+		int _hand;
+		unsigned _threads;
+		uint64_t _seed;
+		bool _draw_first;
+		rules_t _rules;
+	};
+
+	uint64_t games() const { return _games; }
+	int turns() const { return _turns; }
+	const std::vector<card_stats> &cards() const { return _cards; }
+private:
+	goldfish(uint64_t games, int turns) : _games(games), _turns(turns) { }
+
+	uint64_t _games;
+	int _turns;
+	std::vector<card_stats> _cards;
+};
+
+#endif
@@ -2,48 +2,25 @@
 #include <sstream>
 #include <functional>
 #include <vector>
+#include <memory>
 #include <cmath>
+#include <cstdlib>
+#include <cstdint>
+#include <thread>
+#include <exception>
+#include <unordered_map>
+#include <cstring>
 #ifdef __ARM_NEON__
 #include <arm_neon.h>
 #elif __SSE2__
 #include <emmintrin.h>
+#include <immintrin.h>
 #endif
 
 const json_var json_none = json_null();
 
 json_value::~json_value() { }
 
-namespace std {
-template <>
-struct hash<json_string> {
-	size_t operator()(const json_string &x) const noexcept {
-		static const size_t offset_basis = sizeof(size_t) == 4 ? 2166136261U : 14695981039346656037U;
-		static const size_t prime = sizeof(size_t) == 4 ? 16777619U : 1099511628211U;
-		size_t hash = offset_basis;
-		if(!x._multipart) {
-			const char *str = x._value;
-			const char *end = str+x._size;
-			while(str != end) {
-				hash ^= *str++;
-				hash *= prime;
-			}
-		} else {
-			json_string::extent *ext = x._next;
-			while(ext) {
-				const char *str = ext->value();
-				const char *end = str+ext->_size;
-				while(str != end) {
-					hash ^= *str++;
-					hash *= prime;
-				}
-				ext = ext->_next;
-			}
-		}
-		return hash;
-	}
-};
-}
-
 json_null::operator json_boolean() const {
 	return json_boolean(false);
 }
@@ -85,7 +62,7 @@ json_boolean::operator json_object() const {
 }
 
 json_number::operator json_boolean() const {
-	return _value != 0 ? true : false;
+	return (_integer ? _int != 0 : _value != 0) ? true : false;
 }
 
 json_number::operator json_number() const {
@@ -94,7 +71,10 @@ json_number::operator json_number() const {
 
 json_number::operator json_string() const {
 	std::stringstream str;
-	str << _value;
+	if(_integer)
+		str << _int;
+	else
+		str << _value;
 	const std::string &res = str.str();
 	return json_string(res.data(), res.size(), true);
 }
@@ -112,9 +92,11 @@ json_string::operator json_boolean() const {
 }
 
 json_string::operator json_number() const {
-	double rv;
-	std::stringstream str(_value);
-	str >> rv;
+	const std::string &str = *this;
+	json_number rv(0);
+	try {
+		json_read_number(str.data(), str.data()+str.size(), rv);
+	} catch (const json_exception &e) { }
 	return rv;
 }
 
@@ -130,6 +112,37 @@ json_string::operator json_object() const {
 	throw std::logic_error("Attempt to convert JSON string to object");
 }
 
+uint64_t json_string::multipart_hash() const {
+	const size_t size = this->size();
+	uint64_t h = json_hash_k0 ^ size;
+	size_t left = size, fill = 0;
+	char block[16];
+	for(extent *next = _next; next; next = next->_next) {
+		const char *str = next->value();
+		size_t n = next->_size;
+		while(n) {
+			if(!fill && n >= 16 && left > 16) {
+				h = json_hash_block(h, str);
+				str += 16;
+				n -= 16;
+				left -= 16;
+				continue;
+			}
+			const size_t len = std::min(n, sizeof(block) - fill);
+			memcpy(block + fill, str, len);
+			fill += len;
+			str += len;
+			n -= len;
+			if(fill == sizeof(block) && left > 16) {
+				h = json_hash_block(h, block);
+				left -= 16;
+				fill = 0;
+			}
+		}
+	}
+	return json_hash_tail(h, block, fill, size);
+}
+
 bool json_array::contains(const json_string &x) const {
 	for(const auto &item: *this) {
 		try {
@@ -169,40 +182,64 @@ json_array::operator json_object() const {
 	throw std::logic_error("Attempt to convert JSON array to object");
 }
 
-bool json_object::has_key(const json_string &key) const {
-	if(!_index)
-		throw std::logic_error("Must index JSON object before doing lookups by key!");
-	size_t buckets = (size_t)_index[0];
-	size_t bucket = (std::hash<json_string>()(key) % buckets) + 1;
-	for(node *value = _index[bucket]; value; value = value->next) {
-		if(value->value.first == key)
-			return true;
+// Concurrent readers race to claim the index; the winner fills it while the others scan the list.
+json_object::node *json_object::find(const json_string &key) const {
+	node *built = _index && _head ? __atomic_load_n(&_index[0].value, __ATOMIC_ACQUIRE) : nullptr;
+	if(_index && _head && !built) {
+		node *expected = nullptr;
+		if(__atomic_compare_exchange_n(&_index[0].value, &expected, building(), false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+			build_index();
+			built = _head;
+		}
+	}
+	if(!built || built == building()) {
+		for(node *value = _head; value; value = value->next) {
+			if(value->value.first == key)
+				return value;
+		}
+		return nullptr;
+	}
+	size_t mask = _index[0].hash - 1;
+	size_t hash = key.hash();
+	for(size_t i = hash & mask;; i = (i + 1) & mask) {
+		const slot &entry = _index[i+1];
+		if(!entry.value)
+			return nullptr;
+		if(entry.hash == hash && entry.value->value.first == key)
+			return entry.value;
 	}
-	return false;
 }
 
-const json_var &json_object::operator[](const json_string &key) const {
-	if(!_index)
-		throw std::logic_error("Must index JSON object before doing lookups by key!");
-	size_t buckets = (size_t)_index[0];
-	size_t bucket = (std::hash<json_string>()(key) % buckets) + 1;
-	for(node *value = _index[bucket]; value; value = value->next) {
-		if(value->value.first == key)
-			return value->value.second;
+void json_object::build_index() const {
+	size_t capacity = _index[0].hash;
+	size_t mask = capacity - 1;
+	slot *slots = _index+1;
+	memset((void *)slots, 0, sizeof(slot)*capacity);
+	for(node *value = _head; value; value = value->next) {
+		size_t h = value->value.first.hash();
+		size_t i = h & mask;
+		while(slots[i].value)
+			i = (i + 1) & mask;
+		slots[i].hash = h;
+		slots[i].value = value;
 	}
-	return json_none;
+	__atomic_store_n(&_index[0].value, _head, __ATOMIC_RELEASE);
+}
+
+bool json_object::has_key(const json_string &key) const {
+	return find(key) != nullptr;
+}
+
+const json_var &json_object::operator[](const json_string &key) const {
+	node *value = find(key);
+	return value ? value->value.second : json_none;
 }
 
 json_var &json_object::operator[](const json_string &key) {
-	if(!_index)
-		throw std::logic_error("Must index JSON object before doing lookups by key!");
-	size_t buckets = (size_t)_index[0];
-	size_t bucket = (std::hash<json_string>()(key) % buckets) + 1;
-	for(node *value = _index[bucket]; value; value = value->next) {
-		if(value->value.first == key)
-			return value->value.second;
-	}
-	throw std::runtime_error("JSON object key not found");
+	node *value = find(key);
+	if(!value)
+		throw std::runtime_error("JSON object key not found");
+	return value->value.second;
 }
 
 json_object::operator json_boolean() const {
@@ -225,22 +262,273 @@ json_object::operator json_object() const {
 	return *this;
 }
 
-void json_object::index(size_t buckets) {
-	memset((void *)_index, 0, sizeof(node *)*(buckets+1));
-	_index[0] = (node *)buckets;
-	std::hash<json_string> hash;
-	for(node *value = _head; value != nullptr; value = value->next) {
-		value->hash_next = nullptr;
-		size_t bucket = (hash(value->value.first) % buckets) + 1;
-		if(!_index[bucket])
-			_index[bucket] = value;
-		else {
-			node *hashed = _index[bucket];
-			while(hashed->hash_next)
-				hashed = hashed->hash_next;
-			hashed->hash_next = value;
+static inline void json_tape_bound(bool valid) {
+	if(__builtin_expect(!valid, 0))
+		throw std::runtime_error("Corrupt JSON tape snapshot");
+}
+
+static inline void json_tape_bound_string(const json_tape_data *data, uint64_t offset, uint64_t size) {
+	json_tape_bound(offset <= data->string_size && size <= data->string_size - offset);
+}
+
+static inline void json_tape_bound_container(const json_tape_data *data, uint64_t payload, uint64_t width) {
+	const uint64_t begin = payload & UINT32_MAX, size = payload >> 32;
+	json_tape_bound(begin <= data->size && size * width <= data->size - begin);
+}
+
+json_number json_tape_value::number() const {
+	switch(type()) {
+	case INTEGER:
+		return json_number((int64_t)(_word << 4) >> 4);
+	case WIDE_INTEGER:
+		json_tape_bound(payload() < _data->wide_size);
+		return json_number((int64_t)_data->wide_words[payload()]);
+	default: {
+		json_tape_bound(payload() < _data->wide_size);
+		double rv;
+		memcpy(&rv, &_data->wide_words[payload()], sizeof(rv));
+		return json_number(rv);
+	}
+	}
+}
+
+json_string json_tape_value::string() const {
+	if(type() == ATOM) {
+		json_tape_bound(payload() < _data->atom_count);
+		return json_tape_value(_data, _data->atom_words[payload()]).string();
+	}
+	if(type() == STRING) {
+		json_tape_bound_string(_data, _word & pointer_mask, (_word >> 48) & 0xfff);
+		return json_string((const char *)(_data->strings + (_word & pointer_mask)), (_word >> 48) & 0xfff);
+	}
+	json_tape_bound(payload() < _data->wide_size && payload() + 1 < _data->wide_size);
+	json_tape_bound_string(_data, _data->wide_words[payload()], _data->wide_words[payload()+1]);
+	return json_string((const char *)(_data->strings + _data->wide_words[payload()]), _data->wide_words[payload()+1]);
+}
+
+json_tape_value::operator json_boolean() const {
+	switch(type()) {
+	case NONE:
+		return json_null();
+	case BOOLEAN:
+		return json_boolean(payload() != 0);
+	case INTEGER:
+	case WIDE_INTEGER:
+	case DOUBLE:
+		return number();
+	case STRING:
+	case LONG_STRING:
+	case ATOM:
+		return string();
+	case ARRAY:
+		throw std::logic_error("Attempt to convert JSON array to boolean");
+	default:
+		throw std::logic_error("Attempt to convert JSON object to boolean");
+	}
+}
+
+json_tape_value::operator json_number() const {
+	switch(type()) {
+	case NONE:
+		return json_null();
+	case BOOLEAN:
+		return json_boolean(payload() != 0);
+	case INTEGER:
+	case WIDE_INTEGER:
+	case DOUBLE:
+		return number();
+	case STRING:
+	case LONG_STRING:
+	case ATOM:
+		return string();
+	case ARRAY:
+		throw std::logic_error("Attempt to convert JSON array to number");
+	default:
+		throw std::logic_error("Attempt to convert JSON object to number");
+	}
+}
+
+json_tape_value::operator json_string() const {
+	switch(type()) {
+	case NONE:
+		return json_null();
+	case BOOLEAN:
+		return json_boolean(payload() != 0);
+	case INTEGER:
+	case WIDE_INTEGER:
+	case DOUBLE:
+		return number();
+	case STRING:
+	case LONG_STRING:
+	case ATOM:
+		return string();
+	case ARRAY:
+		throw std::logic_error("Attempt to convert JSON array to string");
+	default:
+		throw std::logic_error("Attempt to convert JSON object to string");
+	}
+}
+
+json_tape_value::operator json_tape_array() const {
+	switch(type()) {
+	case ARRAY:
+		json_tape_bound_container(_data, payload(), 1);
+		return json_tape_array(_data, _data->words + (payload() & UINT32_MAX), payload() >> 32);
+	case NONE:
+		throw std::logic_error("Attempt to convert null to JSON array");
+	case OBJECT:
+		throw std::logic_error("Attempt to convert JSON object to array");
+	default:
+		throw std::logic_error("Attempt to convert JSON scalar to array");
+	}
+}
+
+json_tape_value::operator json_tape_object() const {
+	switch(type()) {
+	case OBJECT:
+		json_tape_bound_container(_data, payload(), 2);
+		return json_tape_object(_data, _data->words + (payload() & UINT32_MAX), payload() >> 32);
+	case NONE:
+		throw std::logic_error("Attempt to convert null to JSON object");
+	case ARRAY:
+		throw std::logic_error("Attempt to convert JSON array to object");
+	default:
+		throw std::logic_error("Attempt to convert JSON scalar to object");
+	}
+}
+
+bool json_tape_array::contains(const json_string &x) const {
+	for(auto item: *this) {
+		if(item.type() == json_tape_value::STRING || item.type() == json_tape_value::LONG_STRING) {
+			if(json_string(item) == x)
+				return true;
+		}
+	}
+	return false;
+}
+
+bool json_tape_object::key_equals(const json_tape_data *data, uint64_t word, const json_string &key) {
+	const uint64_t short_key = json_tape_value::make(json_tape_value::STRING, (uint64_t)key._size << 48);
+	const uint64_t short_mask = ~json_tape_value::pointer_mask;
+	if((word & short_mask) == short_key) {
+		json_tape_bound_string(data, word & json_tape_value::pointer_mask, key._size);
+		return memcmp((const char *)(data->strings + (word & json_tape_value::pointer_mask)), key._value, key._size) == 0;
+	} else if(word >> 60 == json_tape_value::LONG_STRING)
+		return json_string(json_tape_value(data, word)) == key;
+	return false;
+}
+
+const uint64_t *json_tape_object::find(const json_string &key) const {
+	if(key._multipart)
+		return find(json_string(std::string(key).c_str()));
+	for(const uint64_t *pos = _begin, *end = _begin+2*_size; pos != end; pos += 2) {
+		json_tape_bound((*pos & json_tape_value::payload_mask) < _data->atom_count);
+		if(key_equals(_data, _data->atom_words[*pos & json_tape_value::payload_mask], key))
+			return pos+1;
+	}
+	return nullptr;
+}
+
+json_atom json_tape::atom(const json_string &key) const {
+	if(key._multipart)
+		return atom(json_string(std::string(key).c_str()));
+	if(_data) {
+		for(size_t i = 0; i < _data->atom_count; ++i) {
+			if(json_tape_object::key_equals(_data.get(), _data->atom_words[i], key))
+				return i;
 		}
 	}
+	return no_atom;
+}
+
+struct json_tape_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint64_t root;
+	uint64_t tape_size;
+	uint64_t wide_size;
+	uint64_t atom_count;
+	uint64_t string_size;
+};
+
+static const char json_tape_magic[8] = {'J', 'S', 'O', 'N', 'T', 'A', 'P', 'E'};
+static const uint32_t json_tape_version = 1;
+static const uint32_t json_tape_byte_order = 0x01020304;
+
+void json_tape::save(std::string &out) const {
+	json_tape_header header;
+	memcpy(header.magic, json_tape_magic, sizeof(header.magic));
+	header.version = json_tape_version;
+	header.byte_order = json_tape_byte_order;
+	header.tape_size = size();
+	header.wide_size = _data ? _data->wide.size() : 0;
+	header.atom_count = _data ? _data->atom_count : 0;
+	std::vector<uint64_t> tape(_data ? _data->words : nullptr, _data ? _data->words + _data->size : nullptr);
+	std::vector<uint64_t> wide(_data ? _data->wide_words : nullptr, _data ? _data->wide_words + header.wide_size : nullptr);
+	std::vector<uint64_t> atoms(_data ? _data->atom_words : nullptr, _data ? _data->atom_words + _data->atom_count : nullptr);
+	std::unordered_map<json_string, uint64_t> offsets;
+	std::string strings;
+	auto relocate = [&](uint64_t &word) {
+		const auto type = (json_tape_value::type_t)(word >> 60);
+		if(type != json_tape_value::STRING && type != json_tape_value::LONG_STRING)
+			return;
+		const json_string x = json_tape_value(_data.get(), word);
+		auto res = offsets.emplace(x, strings.size());
+		if(res.second)
+			strings.append(x._value, x._size);
+		if(type == json_tape_value::STRING)
+			word = (word & ~json_tape_value::pointer_mask) | res.first->second;
+		else
+			wide[word & json_tape_value::payload_mask] = res.first->second;
+	};
+	for(auto &word: tape)
+		relocate(word);
+	for(auto &word: atoms)
+		relocate(word);
+	header.root = _root;
+	relocate(header.root);
+	header.string_size = strings.size();
+	strings.resize((strings.size() + 7) & ~(size_t)7);
+	out.append((const char *)&header, sizeof(header));
+	out.append((const char *)tape.data(), tape.size() * sizeof(uint64_t));
+	out.append((const char *)wide.data(), wide.size() * sizeof(uint64_t));
+	out.append((const char *)atoms.data(), atoms.size() * sizeof(uint64_t));
+	out.append(strings);
+}
+
+json_tape json_tape::view(const void *data, size_t size) {
+	json_tape_header header;
+	if(size < sizeof(header) || (uintptr_t)data % sizeof(uint64_t))
+		throw std::runtime_error("Invalid JSON tape snapshot");
+	memcpy(&header, data, sizeof(header));
+	if(memcmp(header.magic, json_tape_magic, sizeof(header.magic)))
+		throw std::runtime_error("Invalid JSON tape snapshot");
+	if(header.version != json_tape_version || header.byte_order != json_tape_byte_order)
+		throw std::runtime_error("Unsupported JSON tape snapshot version");
+	const size_t words = (size - sizeof(header)) / sizeof(uint64_t);
+	if(header.tape_size > words || header.wide_size > words - header.tape_size ||
+	   header.atom_count > words - header.tape_size - header.wide_size ||
+	   header.string_size > (words - header.tape_size - header.wide_size - header.atom_count) * sizeof(uint64_t))
+		throw std::runtime_error("Truncated JSON tape snapshot");
+	json_tape rv;
+	rv._data.reset(new json_tape_data());
+	auto base = (const uint64_t *)((const char *)data + sizeof(header));
+	rv._data->words = base;
+	rv._data->wide_words = base + header.tape_size;
+	rv._data->atom_words = base + header.tape_size + header.wide_size;
+	rv._data->size = header.tape_size;
+	rv._data->wide_size = header.wide_size;
+	rv._data->atom_count = header.atom_count;
+	rv._data->strings = (uintptr_t)(base + header.tape_size + header.wide_size + header.atom_count);
+	rv._data->string_size = header.string_size;
+	const auto root = (json_tape_value::type_t)(header.root >> 60);
+	if((root == json_tape_value::ARRAY || root == json_tape_value::OBJECT) &&
+	   ((header.root & UINT32_MAX) > header.tape_size ||
+	    (header.root & json_tape_value::payload_mask) >> 32 > (header.tape_size - (header.root & UINT32_MAX)) / (root == json_tape_value::OBJECT ? 2 : 1)))
+		throw std::runtime_error("Truncated JSON tape snapshot");
+	rv._root = header.root;
+	return rv;
 }
 
 json_var::json_var(const json_value &x) {
@@ -265,7 +553,7 @@ json_var::json_var(const json_value &x) {
 		throw std::invalid_argument("json_var::json_var");
 }
 
-json_var::json_var(const json_var &x)  {
+json_var::json_var(const json_var &x) : _type(NONE), _null() {
 	*this = x;
 }
 
@@ -381,10 +669,34 @@ void *json_allocator_base::allocate(size_t n, size_t alignment) {
 	return rv;
 }
 
-void json_document::shrink_to_fit() {
+void json_allocator_heap::shrink_to_fit() {
 	const auto page_size = mapping::page_size();
-	size_t size = (_heap.pos / page_size) * page_size + (_heap.pos % page_size ? page_size : 0);
-	_heap.data.truncate(size);
+	size_t size = (pos / page_size) * page_size + (pos % page_size ? page_size : 0);
+	data.truncate(size);
+}
+
+void json_document::shrink_to_fit() {
+	_heap.shrink_to_fit();
+}
+
+__attribute__((always_inline)) inline bool json_whitespace(char c) {
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+const char *scalar_skip_whitespace(const char *begin, const char *end) {
+	while(begin != end) {
+		switch(*begin) {
+		case ' ':
+		case '\t':
+		case '\r':
+		case '\n':
+			break;
+		default:
+			return begin;
+		}
+		++begin;
+	}
+	return begin;
 }
 
 struct false_cond {
@@ -439,7 +751,35 @@ __attribute__((always_inline)) inline const char *neon_memchr(const char *data,
 	}, [&done]() __attribute__((always_inline)) { return done; });
 	if(data == end)
 		return data;
-	return data + offset;
+	data += offset;
+	return data < end ? data : end;
+}
+
+__attribute__((always_inline)) inline const char *neon_skip_whitespace(const char *data, const char *end) {
+	uint8x16_t index = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+	bool done = false;
+	size_t offset = 0;
+	data = neon_scan(data, end, [&done](char c) __attribute__((always_inline)) {
+		if(!json_whitespace(c))
+			done = true;
+	}, [&done,&offset,index](uint8x16_t haystack) __attribute__((always_inline)) {
+		auto ws = vorrq_u8(vceqq_u8(haystack, vdupq_n_u8(' ')), vceqq_u8(haystack, vdupq_n_u8('\t')));
+		ws = vorrq_u8(ws, vorrq_u8(vceqq_u8(haystack, vdupq_n_u8('\r')), vceqq_u8(haystack, vdupq_n_u8('\n'))));
+		auto res = vorrq_u8(ws, index); // Index or 0xff
+		auto res_min = vpmin_u8(vget_high_u8(res), vget_low_u8(res));
+		res_min = vpmin_u8(res_min, res_min);
+		res_min = vpmin_u8(res_min, res_min);
+		res_min = vpmin_u8(res_min, res_min);
+		auto res_char_min = vget_lane_u8(res_min, 0);
+		if(res_char_min != 0xff) {
+			offset = res_char_min;
+			done = true;
+		}
+	}, [&done]() __attribute__((always_inline)) { return done; });
+	if(data == end)
+		return data;
+	data += offset;
+	return data < end ? data : end;
 }
 #elif __SSE2__
 template <class CharOp, class VecOp, class Cond = false_cond>
@@ -480,24 +820,119 @@ const char *sse2_memchr(const char *data, const char *end, char needle, char nee
 	}, [&done]() { return done; });
 	if(data == end)
 		return data;
-	return data + offset;
+	data += offset;
+	return data < end ? data : end;
 }
-#endif
 
-const char *json_skip_whitespace(const char *begin, const char *end) {
-	while(begin != end) {
-		switch(*begin) {
-		case ' ':
-		case '\t':
-		case '\r':
-		case '\n':
-			break;
-		default:
-			return begin;
+const char *sse2_skip_whitespace(const char *data, const char *end) {
+	bool done = false;
+	size_t offset = 0;
+	data = sse2_scan(data, end, [&done](char c) {
+		if(!json_whitespace(c))
+			done = true;
+	}, [&done,&offset](__m128i haystack) {
+		auto ws = _mm_or_si128(_mm_cmpeq_epi8(haystack, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(haystack, _mm_set1_epi8('\t')));
+		ws = _mm_or_si128(ws, _mm_or_si128(_mm_cmpeq_epi8(haystack, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(haystack, _mm_set1_epi8('\n'))));
+		auto mask = _mm_movemask_epi8(ws) ^ 0xffff;
+		if(mask) {
+			offset = __builtin_ffs(mask)-1;
+			done = true;
 		}
-		++begin;
+	}, [&done]() { return done; });
+	if(data == end)
+		return data;
+	data += offset;
+	return data < end ? data : end;
+}
+
+__attribute__((target("avx2"))) const char *avx2_memchr(const char *data, const char *end, char needle, char needle2) {
+	auto needle_expanded = _mm256_set1_epi8(needle);
+	auto needle2_expanded = _mm256_set1_epi8(needle2);
+	for(; end-data >= 32; data += 32) {
+		auto haystack = _mm256_loadu_si256((const __m256i *)data);
+		auto eq = _mm256_or_si256(_mm256_cmpeq_epi8(haystack, needle_expanded), _mm256_cmpeq_epi8(haystack, needle2_expanded));
+		uint32_t mask = _mm256_movemask_epi8(eq);
+		if(mask)
+			return data + __builtin_ctz(mask);
 	}
-	return begin;
+	return sse2_memchr(data, end, needle, needle2);
+}
+
+__attribute__((target("avx512f,avx512bw"))) const char *avx512_memchr(const char *data, const char *end, char needle, char needle2) {
+	auto needle_expanded = _mm512_set1_epi8(needle);
+	auto needle2_expanded = _mm512_set1_epi8(needle2);
+	while(data < end) {
+		__mmask64 valid = end-data >= 64 ? ~(__mmask64)0 : ((__mmask64)1 << (end-data)) - 1;
+		auto haystack = _mm512_maskz_loadu_epi8(valid, data);
+		uint64_t mask = (_mm512_cmpeq_epi8_mask(haystack, needle_expanded) | _mm512_cmpeq_epi8_mask(haystack, needle2_expanded)) & valid;
+		if(mask)
+			return data + __builtin_ctzll(mask);
+		data += 64;
+	}
+	return end;
+}
+
+__attribute__((target("avx2"))) const char *avx2_skip_whitespace(const char *data, const char *end) {
+	for(; end-data >= 32; data += 32) {
+		auto in = _mm256_loadu_si256((const __m256i *)data);
+		auto ws = _mm256_or_si256(_mm256_cmpeq_epi8(in, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(in, _mm256_set1_epi8('\t')));
+		ws = _mm256_or_si256(ws, _mm256_or_si256(_mm256_cmpeq_epi8(in, _mm256_set1_epi8('\r')), _mm256_cmpeq_epi8(in, _mm256_set1_epi8('\n'))));
+		uint32_t mask = ~_mm256_movemask_epi8(ws);
+		if(mask)
+			return data + __builtin_ctz(mask);
+	}
+	return sse2_skip_whitespace(data, end);
+}
+
+__attribute__((target("avx512f,avx512bw"))) const char *avx512_skip_whitespace(const char *data, const char *end) {
+	while(data < end) {
+		__mmask64 valid = end-data >= 64 ? ~(__mmask64)0 : ((__mmask64)1 << (end-data)) - 1;
+		auto in = _mm512_maskz_loadu_epi8(valid, data);
+		uint64_t ws = _mm512_cmpeq_epi8_mask(in, _mm512_set1_epi8(' ')) | _mm512_cmpeq_epi8_mask(in, _mm512_set1_epi8('\t')) |
+		              _mm512_cmpeq_epi8_mask(in, _mm512_set1_epi8('\r')) | _mm512_cmpeq_epi8_mask(in, _mm512_set1_epi8('\n'));
+		uint64_t mask = ~ws & valid;
+		if(mask)
+			return data + __builtin_ctzll(mask);
+		data += 64;
+	}
+	return end;
+}
+
+struct json_structural_index;
+
+struct json_simd_kernels {
+	const char *(*memchr)(const char *, const char *, char, char);
+	const char *(*skip_whitespace)(const char *, const char *);
+	void (*index_structurals)(json_structural_index &, const char *, const char *);
+};
+
+const json_simd_kernels &json_simd();
+
+__attribute__((always_inline)) inline const char *json_memchr(const char *data, const char *end, char needle, char needle2) {
+	if(end-data >= 16) {
+		auto haystack = _mm_loadu_si128((const __m128i *)data);
+		auto eq = _mm_or_si128(_mm_cmpeq_epi8(haystack, _mm_set1_epi8(needle)), _mm_cmpeq_epi8(haystack, _mm_set1_epi8(needle2)));
+		auto mask = _mm_movemask_epi8(eq);
+		if(mask)
+			return data + __builtin_ctz(mask);
+		data += 16;
+	}
+	return json_simd().memchr(data, end, needle, needle2);
+}
+#endif
+
+const char *json_skip_whitespace(const char *begin, const char *end) {
+	if(begin == end || !json_whitespace(*begin))
+		return begin;
+	if(++begin == end || !json_whitespace(*begin))
+		return begin;
+#ifdef __ARM_NEON__
+	return neon_skip_whitespace(++begin, end);
+#elif __SSE2__
+	return json_simd().skip_whitespace(++begin, end);
+#else
+	return scalar_skip_whitespace(++begin, end);
+#endif
 }
 
 void json_nonempty(const char *begin, const char *end) {
@@ -511,6 +946,15 @@ const char *json_parse_char(const char *begin, const char *end, char c) {
 	throw json_exception("");
 }
 
+const char *json_parse_null(const char *begin, const char *end, json_callbacks &cb) {
+	++begin;
+	begin = json_parse_char(begin, end, 'u');
+	begin = json_parse_char(begin, end, 'l');
+	begin = json_parse_char(begin, end, 'l');
+	cb.null();
+	return begin;
+}
+
 const char *json_parse_boolean(const char *begin, const char *end, json_callbacks &cb) {
 	try {
 		switch(*begin) {
@@ -537,34 +981,62 @@ const char *json_parse_boolean(const char *begin, const char *end, json_callback
 	}
 }
 
-const char *json_parse_number(const char *begin, const char *end, json_callbacks &cb) {
-	long number = 0;
-	long frac = 0;
+static const double json_powers_of_ten[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+double json_parse_double_slow(const char *begin, const char *end) {
+	std::string str(begin, end);
+	return strtod(str.c_str(), nullptr);
+}
+
+const char *json_read_number(const char *begin, const char *end, json_number &value) {
+	static const uint64_t max_exact = (uint64_t)1 << 53;
+	const char *str = begin;
+	uint64_t mantissa = 0;
+	int digits = 0;
 	long exp = 0;
-	int sign = 1;
-	int fracdigits = 0;
-	int expsign = 1;
+	long expvalue = 0;
+	bool negative = false;
+	bool integer = true;
+	bool truncated = false;
 	json_nonempty(begin, end);
 	if(*begin == '-') {
-		sign = -1;
+		negative = true;
 		json_nonempty(++begin, end);
 	}
+	if(*begin < '0' || *begin > '9')
+		throw json_exception("Invalid number");
 	if(*begin != '0') {
 		while(begin != end && *begin >= '0' && *begin <= '9') {
-			number = number*10 + (*begin - '0');
+			if(digits < 19) {
+				mantissa = mantissa*10 + (*begin - '0');
+				++digits;
+			} else {
+				truncated |= *begin != '0';
+				++exp;
+			}
 			++begin;
 		}
 	} else
 		++begin;
 	if(begin != end && *begin == '.') {
+		integer = false;
 		++begin;
 		while(begin != end && *begin >= '0' && *begin <= '9') {
-			frac = frac * 10 + (*begin - '0');
-			++fracdigits;
+			if(digits < 19) {
+				mantissa = mantissa*10 + (*begin - '0');
+				digits += mantissa != 0;
+				--exp;
+			} else
+				truncated |= *begin != '0';
 			++begin;
 		}
 	}
 	if(begin != end && (*begin == 'e' || *begin == 'E')) {
+		integer = false;
+		int expsign = 1;
 		++begin;
 		if(begin != end && *begin == '+')
 			++begin;
@@ -574,11 +1046,37 @@ const char *json_parse_number(const char *begin, const char *end, json_callbacks
 		}
 		json_nonempty(begin, end);
 		while(begin != end && *begin >= '0' && *begin <= '9') {
-			exp = exp*10 + (*begin - '0');
+			if(expvalue < 100000)
+				expvalue = expvalue*10 + (*begin - '0');
 			++begin;
 		}
+		exp += expsign*expvalue;
+	}
+	if(integer && !truncated && exp == 0 && mantissa <= INT64_MAX) {
+		value = json_number(negative ? -(int64_t)mantissa : (int64_t)mantissa);
+		return begin;
+	}
+	if(!truncated && mantissa <= max_exact) {
+		double rv;
+		if(exp >= -22 && exp <= 22) {
+			rv = exp < 0 ? mantissa / json_powers_of_ten[-exp] : mantissa * json_powers_of_ten[exp];
+			value = json_number(negative ? -rv : rv);
+			return begin;
+		}
+		if(exp > 22 && exp <= 22+15 && mantissa <= max_exact / (uint64_t)json_powers_of_ten[exp-22]) {
+			rv = (mantissa * (uint64_t)json_powers_of_ten[exp-22]) * json_powers_of_ten[22];
+			value = json_number(negative ? -rv : rv);
+			return begin;
+		}
 	}
-	cb.number(sign*(number+frac*pow(0.1, fracdigits))*pow(10, expsign*exp));
+	value = json_number(json_parse_double_slow(str, begin));
+	return begin;
+}
+
+const char *json_parse_number(const char *begin, const char *end, json_callbacks &cb) {
+	json_number value(0);
+	begin = json_read_number(begin, end, value);
+	cb.number(value);
 	return begin;
 }
 
@@ -587,15 +1085,17 @@ char *json_str_write(char *pos, char c) {
 	return ++pos;
 }
 
-template <class Allocator>
-void json_str_write_codepoint(json_string_imp<Allocator> &str, unsigned int codepoint) {
-	if(codepoint < 0b10000000) {
-		*str.append_internal(1) = codepoint;
+int json_codepoint_length(unsigned int codepoint) {
+	return codepoint < 0b10000000 ? 1 :
+	       codepoint < 0x800 ? 2 :
+	       codepoint < 0x10000 ? 3 :
+	       4;
+}
+
+void json_write_codepoint(char *pos, unsigned int codepoint, int len) {
+	if(len == 1) {
+		*pos = codepoint;
 	} else {
-		int len = codepoint < 0x800 ? 2 :
-			      codepoint < 0x10000 ? 3 :
-		          4;
-		char *pos = str.append_internal(len);
 		codepoint = codepoint << (32 - 5 * len - 1);
 		pos = json_str_write(pos,  (0xffu << (8 - len)) | ((codepoint & (0xffu << (32 - (7 - len)))) >> (24 + len + 1)));
 		codepoint <<= 7 - len;
@@ -612,6 +1112,12 @@ void json_str_write_codepoint(json_string_imp<Allocator> &str, unsigned int code
 	}
 }
 
+template <class Allocator>
+void json_str_write_codepoint(json_string_imp<Allocator> &str, unsigned int codepoint) {
+	const int len = json_codepoint_length(codepoint);
+	json_write_codepoint(str.append_internal(len), codepoint, len);
+}
+
 int json_parse_hex(const char *begin, const char *end) {
 	json_nonempty(begin, end);
 	if(*begin >= '0' && *begin <= '9')
@@ -624,44 +1130,40 @@ int json_parse_hex(const char *begin, const char *end) {
 		throw json_exception("Unexpected character in unicode escape sequence");
 }
 
+unsigned int json_parse_escape(const char *&begin, const char *end) {
+	unsigned int codepoint;
+	json_nonempty(++begin, end);
+	switch(*begin) {
+	case '"':
+	case '\\':
+	case '/':
+		return *begin;
+	case 'b':
+		return '\b';
+	case 'f':
+		return '\f';
+	case 'n':
+		return '\n';
+	case 'r':
+		return '\r';
+	case 't':
+		return '\t';
+	case 'u':
+		codepoint = json_parse_hex(++begin, end);
+		codepoint = codepoint * 16 + json_parse_hex(++begin, end);
+		codepoint = codepoint * 16 + json_parse_hex(++begin, end);
+		return codepoint * 16 + json_parse_hex(++begin, end);
+	default:
+		throw json_exception("Unrecognized string escape sequence");
+	}
+}
+
 template <class Allocator>
 const char *json_parse_string_slow(json_string_imp<Allocator> &&str, const char *begin, const char *end, json_callbacks &cb) {
 	while(begin != end && *begin != '"') {
-		if(*begin == '\\') {
-			unsigned int codepoint = 0;
-			json_nonempty(++begin, end);
-			switch(*begin) {
-			case '"':
-			case '\\':
-			case '/':
-				*str.append_internal(1) = *begin;
-				break;
-			case 'b':
-				*str.append_internal(1) = '\b';
-				break;
-			case 'f':
-				*str.append_internal(1) = '\f';
-				break;
-			case 'n':
-				*str.append_internal(1) = '\n';
-				break;
-			case 'r':
-				*str.append_internal(1) = '\r';
-				break;
-			case 't':
-				*str.append_internal(1) = '\t';
-				break;
-			case 'u':
-				codepoint = json_parse_hex(++begin, end);
-				codepoint = codepoint * 16 + json_parse_hex(++begin, end);
-				codepoint = codepoint * 16 + json_parse_hex(++begin, end);
-				codepoint = codepoint * 16 + json_parse_hex(++begin, end);
-				json_str_write_codepoint(str, codepoint);
-				break;
-			default:
-				throw json_exception("Unrecognized string escape sequence");
-			}
-		} else
+		if(*begin == '\\')
+			json_str_write_codepoint(str, json_parse_escape(begin, end));
+		else
 			*str.append_internal(1) = *begin;
 		++begin;
 #ifdef __ARM_NEON__
@@ -672,7 +1174,7 @@ const char *json_parse_string_slow(json_string_imp<Allocator> &&str, const char
 			begin = next;
 		}
 #elif __SSE2__
-		const char *next = sse2_memchr(begin, end, '\\', '"');
+		const char *next = json_memchr(begin, end, '\\', '"');
 		size_t size = next-begin;
 		if(size) {
 			str.append(json_string(begin, size));
@@ -710,7 +1212,7 @@ __attribute__((always_inline)) inline const char *json_parse_string(Allocator &a
 	cb.string(json_string(str, begin-str));
 	return ++begin;
 #elif __SSE2__
-	begin = sse2_memchr(begin, end, '\\', '"');
+	begin = json_memchr(begin, end, '\\', '"');
 	if(*begin == '\\')
 		return json_parse_string_slow(make_string_imp(allocator, str, begin), begin, end, cb);
 	json_nonempty(begin, end);
@@ -779,11 +1281,7 @@ const char *json_parse(Allocator &allocator, const char *begin, const char *end,
 	json_nonempty(begin, end);
 	switch(*begin) {
 	case 'n':
-		++begin;
-		begin = json_parse_char(begin, end, 'u');
-		begin = json_parse_char(begin, end, 'l');
-		begin = json_parse_char(begin, end, 'l');
-		cb.null();
+		begin = json_parse_null(begin, end, cb);
 		break;
 	case 't':
 	case 'f':
@@ -820,28 +1318,425 @@ const char *json_parse(const char *begin, const char *end, json_callbacks &cb) {
 	return json_parse(allocator, begin, end, cb);
 }
 
-struct json_parse_callbacks : public json_callbacks {
-	typedef json_array_imp<json_allocator<json_var>> json_arr;
-	typedef json_object_imp<json_allocator<std::pair<json_string, json_var>>> json_obj;
+struct json_block {
+	uint64_t quote;
+	uint64_t backslash;
+	uint64_t whitespace;
+	uint64_t op;
+};
 
-	struct object {
-		const enum {NONE, ARRAY, OBJECT} type;
-		union {
-			json_arr arr;
-			json_obj obj;
-		};
-		json_string key;
-		object() : type(NONE), key(nullptr, 0) { }
-		object(decltype(type) type, const json_allocator<char> &allocator) : type(type), key(nullptr, 0) {
-			switch(type) {
-			case NONE:
-				break;
-			case ARRAY:
-				new (&arr) json_arr(allocator);
-				break;
-			case OBJECT:
-				new (&obj) json_obj(allocator);
-				break;
+#ifdef __ARM_NEON__
+__attribute__((always_inline)) inline uint64_t neon_movemask(uint8x16_t eq) {
+	static const uint8_t bits[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+	auto masked = vandq_u8(eq, vld1q_u8(bits));
+	auto sum = vpadd_u8(vget_low_u8(masked), vget_high_u8(masked));
+	sum = vpadd_u8(sum, sum);
+	sum = vpadd_u8(sum, sum);
+	return vget_lane_u16(vreinterpret_u16_u8(sum), 0);
+}
+
+__attribute__((always_inline)) inline json_block json_classify_block(const char *data) {
+	json_block rv = {0, 0, 0, 0};
+	for(int i = 0; i < 4; ++i) {
+		auto in = vld1q_u8((const uint8_t *)data + 16*i);
+		auto folded = vorrq_u8(in, vdupq_n_u8(0x20));
+		auto ws = vorrq_u8(vceqq_u8(in, vdupq_n_u8(' ')), vceqq_u8(in, vdupq_n_u8('\t')));
+		ws = vorrq_u8(ws, vorrq_u8(vceqq_u8(in, vdupq_n_u8('\r')), vceqq_u8(in, vdupq_n_u8('\n'))));
+		auto op = vorrq_u8(vceqq_u8(folded, vdupq_n_u8('{')), vceqq_u8(folded, vdupq_n_u8('}')));
+		op = vorrq_u8(op, vorrq_u8(vceqq_u8(in, vdupq_n_u8(':')), vceqq_u8(in, vdupq_n_u8(','))));
+		rv.quote |= neon_movemask(vceqq_u8(in, vdupq_n_u8('"'))) << 16*i;
+		rv.backslash |= neon_movemask(vceqq_u8(in, vdupq_n_u8('\\'))) << 16*i;
+		rv.whitespace |= neon_movemask(ws) << 16*i;
+		rv.op |= neon_movemask(op) << 16*i;
+	}
+	return rv;
+}
+#elif __SSE2__
+inline json_block json_classify_block(const char *data) {
+	json_block rv = {0, 0, 0, 0};
+	for(int i = 0; i < 4; ++i) {
+		auto in = _mm_loadu_si128((const __m128i *)(data + 16*i));
+		auto folded = _mm_or_si128(in, _mm_set1_epi8(0x20));
+		auto ws = _mm_or_si128(_mm_cmpeq_epi8(in, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(in, _mm_set1_epi8('\t')));
+		ws = _mm_or_si128(ws, _mm_or_si128(_mm_cmpeq_epi8(in, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(in, _mm_set1_epi8('\n'))));
+		auto op = _mm_or_si128(_mm_cmpeq_epi8(folded, _mm_set1_epi8('{')), _mm_cmpeq_epi8(folded, _mm_set1_epi8('}')));
+		op = _mm_or_si128(op, _mm_or_si128(_mm_cmpeq_epi8(in, _mm_set1_epi8(':')), _mm_cmpeq_epi8(in, _mm_set1_epi8(','))));
+		rv.quote |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(in, _mm_set1_epi8('"'))) << 16*i;
+		rv.backslash |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(in, _mm_set1_epi8('\\'))) << 16*i;
+		rv.whitespace |= (uint64_t)(uint16_t)_mm_movemask_epi8(ws) << 16*i;
+		rv.op |= (uint64_t)(uint16_t)_mm_movemask_epi8(op) << 16*i;
+	}
+	return rv;
+}
+
+__attribute__((target("avx2"))) inline json_block avx2_classify_block(const char *data) {
+	json_block rv = {0, 0, 0, 0};
+	for(int i = 0; i < 2; ++i) {
+		auto in = _mm256_loadu_si256((const __m256i *)(data + 32*i));
+		auto folded = _mm256_or_si256(in, _mm256_set1_epi8(0x20));
+		auto ws = _mm256_or_si256(_mm256_cmpeq_epi8(in, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(in, _mm256_set1_epi8('\t')));
+		ws = _mm256_or_si256(ws, _mm256_or_si256(_mm256_cmpeq_epi8(in, _mm256_set1_epi8('\r')), _mm256_cmpeq_epi8(in, _mm256_set1_epi8('\n'))));
+		auto op = _mm256_or_si256(_mm256_cmpeq_epi8(folded, _mm256_set1_epi8('{')), _mm256_cmpeq_epi8(folded, _mm256_set1_epi8('}')));
+		op = _mm256_or_si256(op, _mm256_or_si256(_mm256_cmpeq_epi8(in, _mm256_set1_epi8(':')), _mm256_cmpeq_epi8(in, _mm256_set1_epi8(','))));
+		rv.quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(in, _mm256_set1_epi8('"'))) << 32*i;
+		rv.backslash |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(in, _mm256_set1_epi8('\\'))) << 32*i;
+		rv.whitespace |= (uint64_t)(uint32_t)_mm256_movemask_epi8(ws) << 32*i;
+		rv.op |= (uint64_t)(uint32_t)_mm256_movemask_epi8(op) << 32*i;
+	}
+	return rv;
+}
+
+__attribute__((target("avx512f,avx512bw"))) inline json_block avx512_classify_block(const char *data) {
+	json_block rv;
+	auto in = _mm512_loadu_si512(data);
+	auto folded = _mm512_or_si512(in, _mm512_set1_epi8(0x20));
+	rv.quote = _mm512_cmpeq_epi8_mask(in, _mm512_set1_epi8('"'));
+	rv.backslash = _mm512_cmpeq_epi8_mask(in, _mm512_set1_epi8('\\'));
+	rv.whitespace = _mm512_cmpeq_epi8_mask(in, _mm512_set1_epi8(' ')) | _mm512_cmpeq_epi8_mask(in, _mm512_set1_epi8('\t')) |
+	                _mm512_cmpeq_epi8_mask(in, _mm512_set1_epi8('\r')) | _mm512_cmpeq_epi8_mask(in, _mm512_set1_epi8('\n'));
+	rv.op = _mm512_cmpeq_epi8_mask(folded, _mm512_set1_epi8('{')) | _mm512_cmpeq_epi8_mask(folded, _mm512_set1_epi8('}')) |
+	        _mm512_cmpeq_epi8_mask(in, _mm512_set1_epi8(':')) | _mm512_cmpeq_epi8_mask(in, _mm512_set1_epi8(','));
+	return rv;
+}
+#else
+inline json_block json_classify_block(const char *data) {
+	json_block rv = {0, 0, 0, 0};
+	for(int i = 0; i < 64; ++i) {
+		uint64_t bit = (uint64_t)1 << i;
+		switch(data[i]) {
+		case '"':
+			rv.quote |= bit;
+			break;
+		case '\\':
+			rv.backslash |= bit;
+			break;
+		case ' ':
+		case '\t':
+		case '\r':
+		case '\n':
+			rv.whitespace |= bit;
+			break;
+		case '{':
+		case '}':
+		case '[':
+		case ']':
+		case ':':
+		case ',':
+			rv.op |= bit;
+			break;
+		}
+	}
+	return rv;
+}
+#endif
+
+struct json_structural_index {
+	const char *begin;
+	const char *end;
+	std::unique_ptr<uint32_t[]> positions;
+	const uint32_t *pos;
+	const uint32_t *last;
+
+	uint32_t *reset(const char *begin, const char *end) {
+		this->begin = begin;
+		this->end = end;
+		positions.reset(new uint32_t[(end-begin)+64]);
+		return positions.get();
+	}
+	size_t size() const { return end-begin; }
+};
+
+struct json_tail_block {
+	char data[64];
+
+	json_tail_block(const char *begin, size_t size) {
+		memset(data, ' ', sizeof(data));
+		memcpy(data, begin, size);
+	}
+};
+
+struct json_structural_scanner {
+	uint64_t escaped;
+	uint64_t in_string;
+	uint64_t scalar;
+	uint64_t escaped_string;
+
+	json_structural_scanner() : escaped(0), in_string(0), scalar(0), escaped_string(0) { }
+
+	uint64_t escapes(uint64_t backslash) {
+		static const uint64_t odd_bits = 0xaaaaaaaaaaaaaaaaULL;
+		if(!backslash) {
+			uint64_t rv = escaped;
+			escaped = 0;
+			return rv;
+		}
+		uint64_t potential = backslash & ~escaped;
+		uint64_t codes = (((potential << 1) | odd_bits) - potential) ^ odd_bits;
+		uint64_t rv = codes ^ (backslash | escaped);
+		escaped = (codes & backslash) >> 63;
+		return rv;
+	}
+
+	static uint64_t prefix_xor(uint64_t x) {
+		x ^= x << 1;
+		x ^= x << 2;
+		x ^= x << 4;
+		x ^= x << 8;
+		x ^= x << 16;
+		x ^= x << 32;
+		return x;
+	}
+
+	uint64_t next(const json_block &block, uint64_t &slow_strings) {
+		uint64_t quote = block.quote & ~escapes(block.backslash);
+		uint64_t strings = prefix_xor(quote) ^ in_string;
+		in_string = (uint64_t)((int64_t)strings >> 63);
+		unsigned long long carry;
+		bool overflow = __builtin_uaddll_overflow(strings, block.backslash & strings, &carry);
+		overflow |= __builtin_uaddll_overflow(carry, escaped_string, &carry);
+		slow_strings = carry & quote & ~strings;
+		escaped_string = overflow;
+		uint64_t scalars = ~(block.op | block.whitespace);
+		uint64_t nonquote = scalars & ~quote;
+		uint64_t follows = (nonquote << 1) | scalar;
+		scalar = nonquote >> 63;
+		return ((block.op | (scalars & ~follows)) & ~(strings & ~quote)) | quote;
+	}
+
+	uint32_t *flatten(uint32_t *out, uint32_t offset, const json_block &block);
+};
+
+__attribute__((always_inline)) inline uint32_t json_flatten_one(uint32_t offset, uint64_t &bits, uint64_t slow_strings) {
+	uint32_t bit = __builtin_ctzll(bits | (1ULL << 63));
+	bits &= bits - 1;
+	return (offset + bit) | (uint32_t)((slow_strings >> bit) & 1) << 31;
+}
+
+__attribute__((always_inline)) inline uint32_t *json_flatten_structurals(uint32_t *out, uint32_t offset, uint64_t bits, uint64_t slow_strings) {
+	int count = __builtin_popcountll(bits);
+	for(int i = 0; i < count; i += 4) {
+		out[i] = json_flatten_one(offset, bits, slow_strings);
+		out[i+1] = json_flatten_one(offset, bits, slow_strings);
+		out[i+2] = json_flatten_one(offset, bits, slow_strings);
+		out[i+3] = json_flatten_one(offset, bits, slow_strings);
+	}
+	return out + count;
+}
+
+__attribute__((always_inline)) inline uint32_t *json_structural_scanner::flatten(uint32_t *out, uint32_t offset, const json_block &block) {
+	uint64_t slow_strings;
+	uint64_t bits = next(block, slow_strings);
+	return json_flatten_structurals(out, offset, bits, slow_strings);
+}
+
+void json_index_finish(json_structural_index &index, const json_structural_scanner &scanner, const uint32_t *out) {
+	if(scanner.in_string)
+		throw json_exception("Unterminated string");
+	index.pos = index.positions.get();
+	index.last = out;
+}
+
+void scalar_index_structurals(json_structural_index &index, const char *begin, const char *end) {
+	json_structural_scanner scanner;
+	uint32_t *out = index.reset(begin, end);
+	size_t offset = 0;
+	for(; offset + 64 <= index.size(); offset += 64)
+		out = scanner.flatten(out, offset, json_classify_block(begin+offset));
+	if(offset < index.size())
+		out = scanner.flatten(out, offset, json_classify_block(json_tail_block(begin+offset, index.size()-offset).data));
+	json_index_finish(index, scanner, out);
+}
+
+#if !defined(__ARM_NEON__) && __SSE2__
+__attribute__((target("avx2"))) void avx2_index_structurals(json_structural_index &index, const char *begin, const char *end) {
+	json_structural_scanner scanner;
+	uint32_t *out = index.reset(begin, end);
+	size_t offset = 0;
+	for(; offset + 64 <= index.size(); offset += 64)
+		out = scanner.flatten(out, offset, avx2_classify_block(begin+offset));
+	if(offset < index.size())
+		out = scanner.flatten(out, offset, avx2_classify_block(json_tail_block(begin+offset, index.size()-offset).data));
+	json_index_finish(index, scanner, out);
+}
+
+__attribute__((target("avx512f,avx512bw"))) void avx512_index_structurals(json_structural_index &index, const char *begin, const char *end) {
+	json_structural_scanner scanner;
+	uint32_t *out = index.reset(begin, end);
+	size_t offset = 0;
+	for(; offset + 64 <= index.size(); offset += 64)
+		out = scanner.flatten(out, offset, avx512_classify_block(begin+offset));
+	if(offset < index.size())
+		out = scanner.flatten(out, offset, avx512_classify_block(json_tail_block(begin+offset, index.size()-offset).data));
+	json_index_finish(index, scanner, out);
+}
+
+json_simd_kernels json_select_kernels() {
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+		return {avx512_memchr, avx512_skip_whitespace, avx512_index_structurals};
+	if(__builtin_cpu_supports("avx2"))
+		return {avx2_memchr, avx2_skip_whitespace, avx2_index_structurals};
+	return {sse2_memchr, sse2_skip_whitespace, scalar_index_structurals};
+}
+
+const json_simd_kernels &json_simd() {
+	static const json_simd_kernels kernels = json_select_kernels();
+	return kernels;
+}
+#endif
+
+void json_index_structurals(json_structural_index &index, const char *begin, const char *end) {
+#ifdef __ARM_NEON__
+	scalar_index_structurals(index, begin, end);
+#elif __SSE2__
+	json_simd().index_structurals(index, begin, end);
+#else
+	scalar_index_structurals(index, begin, end);
+#endif
+}
+
+const char *json_index_next(json_structural_index &index) {
+	if(index.pos == index.last)
+		throw json_exception("Unexpected end of input");
+	return index.begin + (*index.pos++ & INT32_MAX);
+}
+
+const char *json_index_peek(const json_structural_index &index) {
+	return index.pos == index.last ? index.end : index.begin + (*index.pos & INT32_MAX);
+}
+
+bool json_index_match(json_structural_index &index, char c) {
+	if(index.pos != index.last && index.begin[*index.pos & INT32_MAX] == c) {
+		++index.pos;
+		return true;
+	}
+	return false;
+}
+
+template <class Allocator>
+void json_parse_indexed_string(Allocator &allocator, const char *begin, json_structural_index &index, json_callbacks &cb) {
+	if(index.pos == index.last)
+		throw json_exception("Unexpected end of input");
+	uint32_t close = *index.pos++;
+	if(close & ~INT32_MAX) {
+		const char *escape = (const char *)memchr(begin, '\\', index.begin + (close & INT32_MAX) - begin);
+		json_parse_string_slow(make_string_imp(allocator, begin, escape), escape, index.end, cb);
+	} else
+		cb.string(json_string(begin, index.begin + close - begin));
+}
+
+template <class Scalar>
+void json_parse_indexed_scalar(const char *begin, json_structural_index &index, json_callbacks &cb, Scalar &&scalar) {
+	const char *end = json_index_peek(index);
+	if(json_skip_whitespace(scalar(begin, end, cb), end) != end)
+		throw json_exception("Unexpected bare word");
+}
+
+template <class Allocator>
+void json_parse_indexed(Allocator &allocator, json_structural_index &index, json_callbacks &cb);
+
+template <class Allocator>
+void json_parse_indexed_array(Allocator &allocator, json_structural_index &index, json_callbacks &cb) {
+	cb.array_begin();
+	if(json_index_match(index, ']')) {
+		cb.array_end();
+		return;
+	}
+	for(;;) {
+		json_parse_indexed(allocator, index, cb);
+		const char *next = json_index_next(index);
+		if(*next == ']')
+			break;
+		if(*next != ',')
+			throw json_exception("Array members must be separated by commas");
+	}
+	cb.array_end();
+}
+
+template <class Allocator>
+void json_parse_indexed_object(Allocator &allocator, json_structural_index &index, json_callbacks &cb) {
+	cb.object_begin();
+	if(json_index_match(index, '}')) {
+		cb.object_end();
+		return;
+	}
+	for(;;) {
+		const char *key = json_index_next(index);
+		if(*key != '"')
+			throw json_exception("Invalid object key");
+		json_parse_indexed_string(allocator, key+1, index, cb);
+		if(*json_index_next(index) != ':')
+			throw json_exception("Object keys must be followed by colons");
+		json_parse_indexed(allocator, index, cb);
+		const char *next = json_index_next(index);
+		if(*next == '}')
+			break;
+		if(*next != ',')
+			throw json_exception("Object key/value pairs must be separated by commas");
+	}
+	cb.object_end();
+}
+
+template <class Allocator>
+void json_parse_indexed(Allocator &allocator, json_structural_index &index, json_callbacks &cb) {
+	const char *begin = json_index_next(index);
+	switch(*begin) {
+	case 'n':
+		json_parse_indexed_scalar(begin, index, cb, json_parse_null);
+		break;
+	case 't':
+	case 'f':
+		json_parse_indexed_scalar(begin, index, cb, json_parse_boolean);
+		break;
+	case '-':
+	case '0':
+	case '1':
+	case '2':
+	case '3':
+	case '4':
+	case '5':
+	case '6':
+	case '7':
+	case '8':
+	case '9':
+		json_parse_indexed_scalar(begin, index, cb, json_parse_number);
+		break;
+	case '"':
+		json_parse_indexed_string(allocator, begin+1, index, cb);
+		break;
+	case '{':
+		json_parse_indexed_object(allocator, index, cb);
+		break;
+	case '[':
+		json_parse_indexed_array(allocator, index, cb);
+		break;
+	default:
+		throw json_exception("Unexpected character");
+	}
+}
+
+struct json_parse_callbacks : public json_callbacks {
+	typedef json_array_imp<json_allocator<json_var>> json_arr;
+	typedef json_object_imp<json_allocator<std::pair<json_string, json_var>>> json_obj;
+
+	struct object {
+		const enum {NONE, ARRAY, OBJECT} type;
+		union {
+			json_arr arr;
+			json_obj obj;
+		};
+		json_string key;
+		object() : type(NONE), key(nullptr, 0) { }
+		object(decltype(type) type, const json_allocator<char> &allocator) : type(type), key(nullptr, 0) {
+			switch(type) {
+			case NONE:
+				break;
+			case ARRAY:
+				new (&arr) json_arr(allocator);
+				break;
+			case OBJECT:
+				new (&obj) json_obj(allocator);
+				break;
 			}
 		}
 		object(object &&x) : type(x.type), key(x.key) {
@@ -936,3 +1831,595 @@ json_document json_parse(const char *begin, const char *end) {
 	cb.rv.shrink_to_fit();
 	return std::move(cb.rv);
 }
+
+class json_tape_builder : public json_callbacks {
+public:
+	json_tape_builder(json_tape_data &data) : _data(data), _root(0) { }
+	void null() {
+		push(json_tape_value::make(json_tape_value::NONE, 0));
+	}
+	void boolean(const json_boolean &value) {
+		push(json_tape_value::make(json_tape_value::BOOLEAN, value ? 1 : 0));
+	}
+	void number(const json_number &value) {
+		static const int64_t inline_limit = (int64_t)1 << 59;
+		if(value.is_integer() && value.integer() >= -inline_limit && value.integer() < inline_limit) {
+			push(json_tape_value::make(json_tape_value::INTEGER, (uint64_t)value.integer() & json_tape_value::payload_mask));
+		} else if(value.is_integer()) {
+			push(json_tape_value::make(json_tape_value::WIDE_INTEGER, _data.wide.size()));
+			_data.wide.push_back(value.integer());
+		} else {
+			double x = value;
+			uint64_t bits;
+			memcpy(&bits, &x, sizeof(bits));
+			push(json_tape_value::make(json_tape_value::DOUBLE, _data.wide.size()));
+			_data.wide.push_back(bits);
+		}
+	}
+	void string(const json_string &value) {
+		const char *str = value._value;
+		size_t size = value._size;
+		if(value._multipart) {
+			size = 0;
+			for(json_string::extent *next = value._next; next; next = next->_next)
+				size += next->_size;
+			char *copy = (char *)json_allocator_base(&_data.heap).allocate(size, 1);
+			str = copy;
+			for(json_string::extent *next = value._next; next; next = next->_next) {
+				memcpy(copy, next->value(), next->_size);
+				copy += next->_size;
+			}
+		}
+		if(!_frames.empty() && (_frames.back() & 1) && ((_scratch.size() - (_frames.back() >> 1)) & 1) == 0) {
+			push(json_tape_value::make(json_tape_value::ATOM, intern(str, size)));
+		} else
+			push(string_word(str, size));
+	}
+	void array_begin() {
+		_frames.push_back(_scratch.size() << 1);
+	}
+	void array_end() {
+		close(json_tape_value::ARRAY, 1);
+	}
+	void object_begin() {
+		_frames.push_back(_scratch.size() << 1 | 1);
+	}
+	void object_end() {
+		close(json_tape_value::OBJECT, 2);
+	}
+	uint64_t root() const { return _root; }
+	json_atom intern(const json_string &key) {
+		return intern(key._value, key._size);
+	}
+	json_atom intern(const char *str, size_t size) {
+		if(_slots.size() < 2*(_data.atoms.size()+1)) {
+			std::vector<atom_slot> slots(_slots.empty() ? 64 : 2*_slots.size(), atom_slot{0, json_tape::no_atom});
+			for(const atom_slot &slot: _slots) {
+				if(slot.atom == json_tape::no_atom)
+					continue;
+				size_t i = slot.hash & (slots.size()-1);
+				while(slots[i].atom != json_tape::no_atom)
+					i = (i + 1) & (slots.size()-1);
+				slots[i] = slot;
+			}
+			_slots.swap(slots);
+		}
+		uint64_t hash = json_hash(str, size);
+		size_t mask = _slots.size()-1;
+		for(size_t i = hash & mask;; i = (i + 1) & mask) {
+			atom_slot &slot = _slots[i];
+			if(slot.atom == json_tape::no_atom) {
+				slot.hash = hash;
+				slot.atom = _data.atoms.size();
+				_data.atoms.push_back(string_word(str, size));
+				return slot.atom;
+			}
+			if(slot.hash == hash && same_key(_data.atoms[slot.atom], str, size))
+				return slot.atom;
+		}
+	}
+private:
+	bool same_key(uint64_t word, const char *str, size_t size) const {
+		const char *key;
+		size_t key_size;
+		if(word >> 60 == json_tape_value::STRING) {
+			key = (const char *)(uintptr_t)(word & json_tape_value::pointer_mask);
+			key_size = (word >> 48) & 0xfff;
+		} else {
+			key = (const char *)(uintptr_t)_data.wide[word & json_tape_value::payload_mask];
+			key_size = _data.wide[(word & json_tape_value::payload_mask) + 1];
+		}
+		return key_size == size && memcmp(key, str, size) == 0;
+	}
+	struct atom_slot {
+		uint64_t hash;
+		json_atom atom;
+	};
+	uint64_t string_word(const char *str, size_t size) {
+		if(size <= 0xfff && ((uintptr_t)str & ~json_tape_value::pointer_mask) == 0)
+			return json_tape_value::make(json_tape_value::STRING, (uint64_t)size << 48 | (uintptr_t)str);
+		uint64_t word = json_tape_value::make(json_tape_value::LONG_STRING, _data.wide.size());
+		_data.wide.push_back((uintptr_t)str);
+		_data.wide.push_back(size);
+		return word;
+	}
+	void push(uint64_t word) {
+		if(_frames.empty())
+			_root = word;
+		else
+			_scratch.push_back(word);
+	}
+	void close(json_tape_value::type_t type, size_t stride) {
+		size_t start = _frames.back() >> 1;
+		size_t block = _data.tape.size();
+		size_t count = (_scratch.size() - start) / stride;
+		if(block > UINT32_MAX || count >= (1 << 28))
+			throw json_exception("JSON document too large for tape");
+		_data.tape.insert(_data.tape.end(), _scratch.begin()+start, _scratch.end());
+		_scratch.resize(start);
+		_frames.pop_back();
+		push(json_tape_value::make(type, (uint64_t)count << 32 | block));
+	}
+	json_tape_data &_data;
+	std::vector<uint64_t> _scratch;
+	std::vector<size_t> _frames;
+	std::vector<atom_slot> _slots;
+	uint64_t _root;
+};
+
+json_tape json_parse_tape(const char *begin, const char *end) {
+	return json_tape::options().parse(begin, end);
+}
+
+class json_key_set {
+public:
+	json_key_set(const std::vector<std::string> &keys) : _keys(keys) {
+		size_t capacity = 16;
+		while(capacity < 2*keys.size())
+			capacity *= 2;
+		_slots.assign(capacity, nullptr);
+		for(const std::string &key: keys) {
+			size_t i = json_hash(key.data(), key.size()) & (capacity-1);
+			while(_slots[i])
+				i = (i + 1) & (capacity-1);
+			_slots[i] = &key;
+		}
+	}
+	bool empty() const { return _keys.empty(); }
+	bool contains(const char *str, size_t size) const {
+		size_t mask = _slots.size()-1;
+		for(size_t i = json_hash(str, size) & mask; _slots[i]; i = (i + 1) & mask) {
+			if(_slots[i]->size() == size && memcmp(_slots[i]->data(), str, size) == 0)
+				return true;
+		}
+		return false;
+	}
+private:
+	const std::vector<std::string> &_keys;
+	std::vector<const std::string *> _slots;
+};
+
+const uint32_t *json_index_skip(const char *text, const uint32_t *pos, const uint32_t *last) {
+	char c = text[*pos & INT32_MAX];
+	if(c == '"')
+		return pos+2;
+	if(c != '{' && c != '[')
+		return pos+1;
+	int depth = 0;
+	do {
+		c = text[*pos++ & INT32_MAX];
+		if(c == '{' || c == '[')
+			++depth;
+		else if(c == '}' || c == ']')
+			--depth;
+	} while(depth && pos != last);
+	return depth ? last+1 : pos;
+}
+
+template <class Allocator>
+void json_parse_projected(Allocator &allocator, json_structural_index &index, json_callbacks &cb, const json_key_set &keys);
+
+template <class Allocator>
+void json_parse_projected_object(Allocator &allocator, json_structural_index &index, json_callbacks &cb, const json_key_set &keys, bool filter) {
+	cb.object_begin();
+	if(json_index_match(index, '}')) {
+		cb.object_end();
+		return;
+	}
+	for(;;) {
+		const char *key = json_index_next(index);
+		if(*key != '"' || index.pos == index.last)
+			throw json_exception("Invalid object key");
+		uint32_t close = *index.pos;
+		if(!filter || (close & ~INT32_MAX) || keys.contains(key+1, index.begin + close - (key+1))) {
+			json_parse_indexed_string(allocator, key+1, index, cb);
+			if(*json_index_next(index) != ':')
+				throw json_exception("Object keys must be followed by colons");
+			json_parse_projected(allocator, index, cb, keys);
+		} else {
+			++index.pos;
+			if(*json_index_next(index) != ':')
+				throw json_exception("Object keys must be followed by colons");
+			if(index.pos == index.last || (index.pos = json_index_skip(index.begin, index.pos, index.last)) > index.last)
+				throw json_exception("Unexpected end of input");
+		}
+		const char *next = json_index_next(index);
+		if(*next == '}')
+			break;
+		if(*next != ',')
+			throw json_exception("Object key/value pairs must be separated by commas");
+	}
+	cb.object_end();
+}
+
+template <class Allocator>
+void json_parse_projected(Allocator &allocator, json_structural_index &index, json_callbacks &cb, const json_key_set &keys) {
+	switch(*json_index_peek(index)) {
+	case '{':
+		++index.pos;
+		json_parse_projected_object(allocator, index, cb, keys, true);
+		break;
+	case '[':
+		++index.pos;
+		cb.array_begin();
+		if(json_index_match(index, ']')) {
+			cb.array_end();
+			return;
+		}
+		for(;;) {
+			json_parse_projected(allocator, index, cb, keys);
+			const char *next = json_index_next(index);
+			if(*next == ']')
+				break;
+			if(*next != ',')
+				throw json_exception("Array members must be separated by commas");
+		}
+		cb.array_end();
+		break;
+	default:
+		json_parse_indexed(allocator, index, cb);
+	}
+}
+
+struct json_tape_member {
+	const uint32_t *begin;
+	const uint32_t *end;
+};
+
+bool json_split_members(const json_structural_index &index, std::vector<json_tape_member> &members) {
+	const uint32_t *pos = index.pos, *last = index.last;
+	auto at = [&](const uint32_t *x) { return index.begin[*x & INT32_MAX]; };
+	if(last - pos < 2 || at(pos++) != '{' || at(pos) == '}')
+		return false;
+	for(;;) {
+		const uint32_t *start = pos;
+		if(last - pos < 4 || at(pos) != '"' || at(pos+2) != ':')
+			return false;
+		pos = json_index_skip(index.begin, pos+3, last);
+		if(pos >= last)
+			return false;
+		members.push_back({start, pos});
+		char c = at(pos++);
+		if(c == '}')
+			return pos == last;
+		if(c != ',')
+			return false;
+	}
+}
+
+template <class Fn>
+void json_parallel_for(unsigned n, Fn &&fn) {
+	std::vector<std::exception_ptr> errors(n);
+	std::vector<std::thread> workers;
+	auto run = [&](unsigned i) {
+		try {
+			fn(i);
+		} catch(...) {
+			errors[i] = std::current_exception();
+		}
+	};
+	for(unsigned i = 1; i < n; ++i)
+		workers.emplace_back(run, i);
+	run(0);
+	for(auto &worker: workers)
+		worker.join();
+	for(auto &error: errors) {
+		if(error)
+			std::rethrow_exception(error);
+	}
+}
+
+uint64_t json_tape_relocate(uint64_t word, size_t tape, size_t wide, const std::vector<json_atom> &atoms) {
+	uint64_t payload = word & json_tape_value::payload_mask;
+	switch((json_tape_value::type_t)(word >> 60)) {
+	case json_tape_value::ARRAY:
+	case json_tape_value::OBJECT:
+		return word + tape;
+	case json_tape_value::WIDE_INTEGER:
+	case json_tape_value::DOUBLE:
+	case json_tape_value::LONG_STRING:
+		return word + wide;
+	case json_tape_value::ATOM:
+		return json_tape_value::make(json_tape_value::ATOM, atoms[payload]);
+	default:
+		return word;
+	}
+}
+
+json_tape json_tape::options::parse(const char *begin, const char *end) const {
+	std::vector<json_tape_member> members;
+	json_structural_index index;
+	json_key_set keys(_keep);
+	unsigned threads = _threads;
+	if((size_t)(end-begin) < INT32_MAX) {
+		json_index_structurals(index, begin, end);
+		if(threads > 1 && (!json_split_members(index, members) || members.size() < 2))
+			members.clear();
+	}
+	if(members.empty()) {
+		json_tape rv;
+		rv._data.reset(new json_tape_data((end-begin)*sizeof(void *)));
+		rv._data->tape.reserve((end-begin)/16);
+		json_tape_builder builder(*rv._data);
+		json_allocator<char> allocator(&rv._data->heap);
+		if((size_t)(end-begin) >= INT32_MAX)
+			json_parse(allocator, begin, end, builder);
+		else if(keys.empty())
+			json_parse_indexed(allocator, index, builder);
+		else if(json_index_match(index, '{'))
+			json_parse_projected_object(allocator, index, builder, keys, false);
+		else
+			json_parse_projected(allocator, index, builder, keys);
+		rv._data->heap.shrink_to_fit();
+		rv._data->publish();
+		rv._root = builder.root();
+		return rv;
+	}
+
+	std::vector<const json_tape_member *> groups(1, &members[0]);
+	size_t total = members.back().end - members.front().begin;
+	for(const json_tape_member &member: members) {
+		if(groups.size() == threads)
+			break;
+		if((size_t)(member.end - members.front().begin)*threads >= total*groups.size())
+			groups.push_back(&member+1);
+	}
+	if(groups.back() == &members[0] + members.size())
+		groups.pop_back();
+	threads = groups.size();
+	groups.push_back(&members[0] + members.size());
+
+	std::vector<std::unique_ptr<json_tape_data>> parts(threads);
+	std::vector<uint64_t> roots(threads);
+	json_parallel_for(threads, [&](unsigned i) {
+		size_t bytes = (*(groups[i+1]-1)->end & INT32_MAX) - (*groups[i]->begin & INT32_MAX);
+		parts[i].reset(new json_tape_data(bytes*sizeof(void *)));
+		parts[i]->tape.reserve(bytes/16);
+		json_tape_builder builder(*parts[i]);
+		json_allocator<char> allocator(&parts[i]->heap);
+		json_structural_index view;
+		view.begin = index.begin;
+		view.end = index.end;
+		builder.object_begin();
+		for(const json_tape_member *member = groups[i]; member != groups[i+1]; ++member) {
+			view.pos = member->begin;
+			view.last = member->end+1;
+			const char *key = json_index_next(view);
+			json_parse_indexed_string(allocator, key+1, view, builder);
+			json_index_next(view);
+			if(keys.empty())
+				json_parse_indexed(allocator, view, builder);
+			else
+				json_parse_projected(allocator, view, builder, keys);
+		}
+		builder.object_end();
+		parts[i]->heap.shrink_to_fit();
+		parts[i]->publish();
+		roots[i] = builder.root();
+	});
+
+	json_tape rv;
+	rv._data.reset(new json_tape_data(1));
+	json_tape_builder merged(*rv._data);
+	std::vector<size_t> tape_offsets(threads), wide_offsets(threads);
+	std::vector<std::vector<json_atom>> atoms(threads);
+	size_t tape_size = 0, wide_size = 0, count = 0;
+	for(unsigned i = 0; i < threads; ++i) {
+		tape_offsets[i] = tape_size;
+		wide_offsets[i] = wide_size;
+		tape_size += roots[i] & UINT32_MAX;
+		wide_size += parts[i]->wide.size();
+		count += (roots[i] & json_tape_value::payload_mask) >> 32;
+	}
+	if(tape_size + 2*count > UINT32_MAX || count >= (1 << 28))
+		throw json_exception("JSON document too large for tape");
+	rv._data->wide.reserve(wide_size);
+	for(unsigned i = 0; i < threads; ++i)
+		rv._data->wide.insert(rv._data->wide.end(), parts[i]->wide.begin(), parts[i]->wide.end());
+	for(unsigned i = 0; i < threads; ++i) {
+		for(uint64_t word: parts[i]->atoms) {
+			atoms[i].push_back(merged.intern(json_tape_value(parts[i].get(), word)));
+		}
+	}
+
+	rv._data->tape.resize(tape_size + 2*count);
+	std::vector<size_t> root_offsets(threads);
+	for(unsigned i = 0, pos = tape_size; i < threads; ++i) {
+		root_offsets[i] = pos;
+		pos += 2*((roots[i] & json_tape_value::payload_mask) >> 32);
+	}
+	json_parallel_for(threads, [&](unsigned i) {
+		const std::vector<uint64_t> &tape = parts[i]->tape;
+		size_t block = roots[i] & UINT32_MAX;
+		uint64_t *out = &rv._data->tape[tape_offsets[i]];
+		for(size_t j = 0; j < block; ++j)
+			out[j] = json_tape_relocate(tape[j], tape_offsets[i], wide_offsets[i], atoms[i]);
+		out = &rv._data->tape[root_offsets[i]];
+		for(size_t j = block; j < tape.size(); ++j)
+			out[j-block] = json_tape_relocate(tape[j], tape_offsets[i], wide_offsets[i], atoms[i]);
+	});
+	for(auto &part: parts)
+		rv._data->arenas.push_back(std::move(part->heap));
+	rv._data->publish();
+	rv._root = json_tape_value::make(json_tape_value::OBJECT, (uint64_t)count << 32 | tape_size);
+	return rv;
+}
+
+json_string json_cursor_unescape(const char *begin, const char *end) {
+	std::string res;
+	for(; begin != end && *begin != '"'; ++begin) {
+		if(*begin == '\\') {
+			const unsigned int codepoint = json_parse_escape(begin, end);
+			const int len = json_codepoint_length(codepoint);
+			res.resize(res.size() + len);
+			json_write_codepoint(&res[res.size() - len], codepoint, len);
+		} else
+			res += *begin;
+	}
+	json_nonempty(begin, end);
+	return json_string(res.data(), res.size(), true);
+}
+
+class json_cursor_capture : public json_callbacks {
+public:
+	void null() { value = json_null(); }
+	void boolean(const json_boolean &x) { value = x; }
+	void number(const json_number &x) { value = x; }
+	void string(const json_string &x) { value = x; }
+	void array_begin() { }
+	void array_end() { }
+	void object_begin() { }
+	void object_end() { }
+	json_var value;
+};
+
+json_ondemand json_parse_ondemand(const char *begin, const char *end) {
+	if((size_t)(end-begin) >= INT32_MAX)
+		throw json_exception("JSON document too large for on-demand parsing");
+	json_structural_index index;
+	json_index_structurals(index, begin, end);
+	if(index.pos == index.last)
+		throw json_exception("Unexpected end of input");
+	json_ondemand rv;
+	rv._begin = begin;
+	rv._end = end;
+	rv._last = index.last;
+	rv._positions = std::move(index.positions);
+	return rv;
+}
+
+char json_cursor::kind() const {
+	return _doc->_begin[*_pos & INT32_MAX];
+}
+
+const uint32_t *json_cursor::skip(const uint32_t *pos) const {
+	pos = json_index_skip(_doc->_begin, pos, _doc->_last);
+	if(pos >= _doc->_last)
+		throw json_exception("Unexpected end of input");
+	return pos;
+}
+
+json_var json_cursor::value() const {
+	if(!_pos)
+		return json_null();
+	const char *begin = _doc->_begin + (*_pos & INT32_MAX);
+	const char *end = _pos+1 == _doc->_last ? _doc->_end : _doc->_begin + (_pos[1] & INT32_MAX);
+	json_cursor_capture cb;
+	switch(*begin) {
+	case '"':
+		if(_pos+1 == _doc->_last)
+			throw json_exception("Unexpected end of input");
+		if(!(_pos[1] & ~INT32_MAX))
+			return json_string(begin+1, end-(begin+1));
+		return json_cursor_unescape(begin+1, _doc->_end);
+	case '[':
+		throw std::logic_error("Attempt to convert JSON array to scalar");
+	case '{':
+		throw std::logic_error("Attempt to convert JSON object to scalar");
+	case 'n':
+		begin = json_parse_null(begin, end, cb);
+		break;
+	case 't':
+	case 'f':
+		begin = json_parse_boolean(begin, end, cb);
+		break;
+	default:
+		begin = json_parse_number(begin, end, cb);
+	}
+	if(json_skip_whitespace(begin, end) != end)
+		throw json_exception("Unexpected bare word");
+	return cb.value;
+}
+
+bool json_cursor::is_null() const {
+	return !_pos || kind() == 'n';
+}
+
+json_cursor::operator json_boolean() const {
+	return value();
+}
+
+json_cursor::operator json_number() const {
+	return value();
+}
+
+json_cursor::operator json_string() const {
+	return value();
+}
+
+json_cursor::const_iterator &json_cursor::const_iterator::operator++() {
+	_pos = json_cursor(_doc, _pos).skip(_pos);
+	if(_doc->_begin[*_pos & INT32_MAX] == ',')
+		++_pos;
+	return *this;
+}
+
+json_cursor::const_iterator json_cursor::begin() const {
+	if(!is_array())
+		throw std::logic_error("Attempt to iterate over non-array JSON value");
+	const uint32_t *pos = _pos+1;
+	if(pos == _doc->_last)
+		throw json_exception("Unexpected end of input");
+	return const_iterator(_doc, pos);
+}
+
+json_cursor::const_iterator json_cursor::end() const {
+	if(!is_array())
+		throw std::logic_error("Attempt to iterate over non-array JSON value");
+	return const_iterator(_doc, skip(_pos)-1);
+}
+
+size_t json_cursor::size() const {
+	size_t rv = 0;
+	for(auto i = begin(), e = end(); i != e; ++i)
+		++rv;
+	return rv;
+}
+
+json_cursor json_cursor::operator[](size_t i) const {
+	for(auto x = begin(), e = end(); x != e; ++x) {
+		if(!i--)
+			return *x;
+	}
+	throw std::out_of_range("JSON array index out of range");
+}
+
+json_cursor json_cursor::operator[](const json_string &key) const {
+	if(!is_object())
+		throw std::logic_error("Attempt to look up a key in non-object JSON value");
+	const char *text = _doc->_begin;
+	const uint32_t *pos = _pos+1;
+	if(pos != _doc->_last && text[*pos & INT32_MAX] == '}')
+		return json_cursor();
+	for(;;) {
+		if(_doc->_last - pos < 4 || text[*pos & INT32_MAX] != '"' || text[pos[2] & INT32_MAX] != ':')
+			throw json_exception("Invalid object key");
+		if(json_string(json_cursor(_doc, pos)) == key)
+			return json_cursor(_doc, pos+3);
+		pos = skip(pos+3);
+		if(text[*pos & INT32_MAX] == '}')
+			return json_cursor();
+		if(text[*pos++ & INT32_MAX] != ',')
+			throw json_exception("Object key/value pairs must be separated by commas");
+	}
+}
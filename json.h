@@ -4,7 +4,11 @@
 #include <new>
 #include <cstring>
 #include <cstddef>
+#include <cstdint>
 #include <sstream>
+#include <stdexcept>
+#include <memory>
+#include <vector>
 #include "mapping.h"
 
 class json_boolean;
@@ -14,6 +18,53 @@ class json_array;
 class json_object;
 class json_var;
 
+inline uint64_t json_hash_mix(uint64_t a, uint64_t b) {
+#ifdef __SIZEOF_INT128__
+	__uint128_t r = (__uint128_t)a * b;
+	return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else
+	uint64_t r = (a ^ (a >> 32)) * (b | 1);
+	return r ^ (r >> 29) ^ b;
+#endif
+}
+
+static const uint64_t json_hash_k0 = 0xa0761d6478bd642fULL, json_hash_k1 = 0xe7037ed1a0b428dbULL, json_hash_k2 = 0x8ebc6af09c88c6e3ULL;
+
+inline uint64_t json_hash_block(uint64_t h, const char *str) {
+	uint64_t a, b;
+	memcpy(&a, str, 8);
+	memcpy(&b, str+8, 8);
+	return json_hash_mix(a ^ json_hash_k1, b ^ h);
+}
+
+inline uint64_t json_hash_tail(uint64_t h, const char *str, size_t n, size_t size) {
+	uint64_t a = 0, b = 0;
+	if(n >= 8) {
+		memcpy(&a, str, 8);
+		memcpy(&b, str+n-8, 8);
+	} else if(n >= 4) {
+		uint32_t lo, hi;
+		memcpy(&lo, str, 4);
+		memcpy(&hi, str+n-4, 4);
+		a = lo;
+		b = hi;
+	} else if(n) {
+		a = (uint64_t)(unsigned char)str[0] << 16 | (uint64_t)(unsigned char)str[n>>1] << 8 | (unsigned char)str[n-1];
+	}
+	return json_hash_mix(json_hash_k2 ^ size, json_hash_mix(a ^ json_hash_k1, b ^ h));
+}
+
+inline uint64_t json_hash(const char *str, size_t size) {
+	uint64_t h = json_hash_k0 ^ size;
+	size_t n = size;
+	while(n > 16) {
+		h = json_hash_block(h, str);
+		str += 16;
+		n -= 16;
+	}
+	return json_hash_tail(h, str, n, size);
+}
+
 class json_value {
 public:
 	virtual ~json_value();
@@ -48,15 +99,29 @@ private:
 
 class json_number : public json_value {
 public:
-	json_number(double value) : _value(value) { }
+	json_number(double value) : _value(value), _integer(false) { }
+	json_number(int64_t value) : _int(value), _integer(true) { }
+	json_number(int value) : json_number((int64_t)value) { }
 	__attribute__((pure)) operator json_boolean() const;
 	__attribute__((pure)) operator json_number() const;
 	__attribute__((pure)) operator json_string() const;
 	__attribute__((pure)) operator json_array() const;
 	__attribute__((pure)) operator json_object() const;
-	__attribute__((pure)) operator double() const { return _value; }
+	__attribute__((pure)) operator double() const { return _integer ? _int : _value; }
+	bool is_integer() const { return _integer; }
+	int64_t integer() const {
+		if(_integer)
+			return _int;
+		if(!(_value >= -9223372036854775808.0 && _value < 9223372036854775808.0))
+			throw std::range_error("JSON number out of integer range");
+		return _value;
+	}
 private:
-	double _value;
+	union {
+		double _value;
+		int64_t _int;
+	};
+	bool _integer;
 };
 
 class json_string : public json_value {
@@ -186,6 +251,20 @@ public:
 	}
 	bool empty() const { return !_size && !_multipart; }
 	bool is_null() const { return !_multipart && !_value; }
+	const char *data() const { return _multipart ? nullptr : _value; }
+	size_t size() const {
+		if(!_multipart)
+			return _size;
+		size_t res = 0;
+		for(extent *next = _next; next; next = next->_next)
+			res += next->_size;
+		return res;
+	}
+	uint64_t hash() const {
+		if(!_multipart)
+			return json_hash(_value, _size);
+		return multipart_hash();
+	}
 	const_iterator begin() const {
 		if(!_multipart) {
 			if(_size)
@@ -230,6 +309,8 @@ public:
 		return dst == x.end();
 	}
 private:
+	uint64_t multipart_hash() const;
+
 	union {
 		const char *_value;
 		extent *_next;
@@ -240,9 +321,20 @@ private:
 	
 	friend std::ostream &operator<<(std::ostream &, const json_string &);
 	template <class Allocator> friend class json_string_imp;
-	friend class std::hash<json_string>;
+	friend class json_tape_builder;
+	friend class json_tape_object;
+	friend class json_tape;
 };
 
+namespace std {
+template <>
+struct hash<json_string> {
+	size_t operator()(const json_string &x) const noexcept {
+		return x.hash();
+	}
+};
+}
+
 inline std::ostream &operator<<(std::ostream &out, const json_string &x) {
 	if(!x._multipart) {
 		out.write(x._value, x._size);
@@ -434,9 +526,16 @@ public:
 	__attribute__((pure)) operator json_array() const;
 	__attribute__((pure)) operator json_object() const;
 protected:
-	void index(size_t buckets);
+	struct slot {
+		size_t hash;
+		node *value;
+	};
+	static const size_t linear_limit = 8;
+	node *find(const json_string &key) const;
+	void build_index() const;
+	node *building() const { return reinterpret_cast<node *>(_index); }
 	node *_head;
-	node **_index;
+	slot *_index;
 };
 
 template <class Allocator = std::allocator<std::pair<json_string, json_var>>>
@@ -568,17 +667,16 @@ struct json_array::node {
 struct json_object::node {
 	std::pair<json_string, json_var> value;
 	node *next;
-	node *hash_next;
 
-	node(const json_string &key, const json_null &value) : value(key, value), next(nullptr), hash_next(nullptr) { }
-	node(const json_string &key, const json_boolean &value) : value(key, value), next(nullptr), hash_next(nullptr) { }
-	node(const json_string &key, const json_number &value) : value(key, value), next(nullptr), hash_next(nullptr) { }
-	node(const json_string &key, const json_string &value) : value(key, value), next(nullptr), hash_next(nullptr) { }
-	node(const json_string &key, const json_value &value) : value(key, value), next(nullptr), hash_next(nullptr) { }
+	node(const json_string &key, const json_null &value) : value(key, value), next(nullptr) { }
+	node(const json_string &key, const json_boolean &value) : value(key, value), next(nullptr) { }
+	node(const json_string &key, const json_number &value) : value(key, value), next(nullptr) { }
+	node(const json_string &key, const json_string &value) : value(key, value), next(nullptr) { }
+	node(const json_string &key, const json_value &value) : value(key, value), next(nullptr) { }
 	template <class Allocator>
-	node(const json_string &key, json_array_imp<Allocator> &&value) : value(key, std::move(value)), next(nullptr), hash_next(nullptr) { }
+	node(const json_string &key, json_array_imp<Allocator> &&value) : value(key, std::move(value)), next(nullptr) { }
 	template <class Allocator>
-	node(const json_string &key, json_object_imp<Allocator> &&value) : value(key, std::move(value)), next(nullptr), hash_next(nullptr) { }
+	node(const json_string &key, json_object_imp<Allocator> &&value) : value(key, std::move(value)), next(nullptr) { }
 };
 
 struct json_allocator_heap {
@@ -591,6 +689,7 @@ struct json_allocator_heap {
 		this->operator=(std::move(x));
 	}
 	json_allocator_heap(size_t n);
+	void shrink_to_fit();
 
 	json_allocator_heap &operator=(json_allocator_heap &&x) {
 		options = x.options;
@@ -675,6 +774,262 @@ private:
 	friend json_document json_parse(const char *, const char *);
 };
 
+class json_tape_array;
+class json_tape_object;
+
+typedef uint32_t json_atom;
+
+struct json_tape_data {
+	const uint64_t *words;
+	const uint64_t *wide_words;
+	const uint64_t *atom_words;
+	size_t size;
+	size_t wide_size;
+	size_t atom_count;
+	uintptr_t strings;
+	size_t string_size;
+	std::vector<uint64_t> tape;
+	std::vector<uint64_t> wide;
+	std::vector<uint64_t> atoms;
+	json_allocator_heap heap;
+	std::vector<json_allocator_heap> arenas;
+
+	json_tape_data() : words(nullptr), wide_words(nullptr), atom_words(nullptr), size(0), wide_size(0), atom_count(0), strings(0), string_size(SIZE_MAX) { }
+	json_tape_data(size_t n) : words(nullptr), wide_words(nullptr), atom_words(nullptr), size(0), wide_size(0), atom_count(0), strings(0), string_size(SIZE_MAX), heap(n) { }
+	void publish() {
+		words = tape.data();
+		wide_words = wide.data();
+		atom_words = atoms.data();
+		size = tape.size();
+		wide_size = wide.size();
+		atom_count = atoms.size();
+	}
+};
+
+class json_tape_value {
+public:
+	enum type_t {NONE, BOOLEAN, INTEGER, WIDE_INTEGER, DOUBLE, STRING, LONG_STRING, ARRAY, OBJECT, ATOM};
+
+	json_tape_value() : _data(nullptr), _word(0) { }
+	json_tape_value(const json_tape_data *data, uint64_t word) : _data(data), _word(word) { }
+	type_t type() const { return (type_t)(_word >> 60); }
+	uint64_t word() const { return _word; }
+	bool is_null() const { return type() == NONE; }
+	__attribute__((pure)) operator json_boolean() const;
+	__attribute__((pure)) operator json_number() const;
+	__attribute__((pure)) operator json_string() const;
+	__attribute__((pure)) operator json_tape_array() const;
+	__attribute__((pure)) operator json_tape_object() const;
+
+	static uint64_t make(type_t type, uint64_t payload) { return (uint64_t)type << 60 | payload; }
+	static const uint64_t payload_mask = ((uint64_t)1 << 60) - 1;
+	static const uint64_t pointer_mask = ((uint64_t)1 << 48) - 1;
+private:
+	uint64_t payload() const { return _word & payload_mask; }
+	json_number number() const;
+	json_string string() const;
+	const json_tape_data *_data;
+	uint64_t _word;
+
+	friend class json_tape_object;
+};
+
+class json_tape_array {
+public:
+	class const_iterator {
+	public:
+		const_iterator(const const_iterator &x) : _data(x._data), _pos(x._pos) { }
+		const_iterator &operator++() { ++_pos; return *this; }
+		json_tape_value operator*() const { return json_tape_value(_data, *_pos); }
+		const json_tape_value *operator->() const {
+			_value = **this;
+			return &_value;
+		}
+		bool operator!=(const const_iterator &x) const { return _pos != x._pos; }
+		bool operator==(const const_iterator &x) const { return _pos == x._pos; }
+	private:
+		const_iterator(const json_tape_data *data, const uint64_t *pos) : _data(data), _pos(pos) { }
+		const json_tape_data *_data;
+		const uint64_t *_pos;
+		mutable json_tape_value _value;
+
+		friend class json_tape_array;
+	};
+
+	json_tape_array() : _data(nullptr), _begin(nullptr), _size(0) { }
+	json_tape_array(const json_tape_data *data, const uint64_t *begin, size_t size) : _data(data), _begin(begin), _size(size) { }
+
+	const_iterator begin() const { return const_iterator(_data, _begin); }
+	const_iterator end() const { return const_iterator(_data, _begin+_size); }
+	size_t size() const { return _size; }
+	json_tape_value operator[](size_t i) const { return json_tape_value(_data, _begin[i]); }
+	bool contains(const json_string &x) const;
+private:
+	const json_tape_data *_data;
+	const uint64_t *_begin;
+	size_t _size;
+};
+
+class json_tape_object {
+public:
+	typedef std::pair<json_string, json_tape_value> value_type;
+
+	class const_iterator {
+	public:
+		const_iterator(const const_iterator &x) : _data(x._data), _pos(x._pos), _value(x._value) { }
+		const_iterator &operator++() {
+			_pos += 2;
+			_value.first = json_string(nullptr, 0);
+			return *this;
+		}
+		const value_type &operator*() const {
+			if(_value.first.is_null())
+				_value = value_type(json_tape_value(_data, _pos[0]), json_tape_value(_data, _pos[1]));
+			return _value;
+		}
+		const value_type *operator->() const { return &**this; }
+		bool operator!=(const const_iterator &x) const { return _pos != x._pos; }
+		bool operator==(const const_iterator &x) const { return _pos == x._pos; }
+	private:
+		const_iterator(const json_tape_data *data, const uint64_t *pos) : _data(data), _pos(pos), _value(json_string(nullptr, 0), json_tape_value()) { }
+		const json_tape_data *_data;
+		const uint64_t *_pos;
+		mutable value_type _value;
+
+		friend class json_tape_object;
+	};
+
+	json_tape_object() : _data(nullptr), _begin(nullptr), _size(0) { }
+	json_tape_object(const json_tape_data *data, const uint64_t *begin, size_t size) : _data(data), _begin(begin), _size(size) { }
+
+	const_iterator begin() const { return const_iterator(_data, _begin); }
+	const_iterator end() const { return const_iterator(_data, _begin+2*_size); }
+	size_t size() const { return _size; }
+	uint64_t word() const { return json_tape_value::make(json_tape_value::OBJECT, (uint64_t)_size << 32 | (_begin - _data->words)); }
+	bool has_key(const json_string &key) const { return find(key); }
+	bool has_key(json_atom key) const { return find(key); }
+	json_tape_value operator[](const json_string &key) const {
+		const uint64_t *value = find(key);
+		return value ? json_tape_value(_data, *value) : json_tape_value(_data, 0);
+	}
+	json_tape_value operator[](json_atom key) const {
+		const uint64_t *value = find(key);
+		return value ? json_tape_value(_data, *value) : json_tape_value(_data, 0);
+	}
+private:
+	static bool key_equals(const json_tape_data *data, uint64_t word, const json_string &key);
+	const uint64_t *find(const json_string &key) const;
+	const uint64_t *find(json_atom key) const {
+		const uint64_t word = json_tape_value::make(json_tape_value::ATOM, key);
+		for(const uint64_t *pos = _begin, *end = _begin+2*_size; pos != end; pos += 2) {
+			if(*pos == word)
+				return pos+1;
+		}
+		return nullptr;
+	}
+	const json_tape_data *_data;
+	const uint64_t *_begin;
+	size_t _size;
+
+	friend class json_tape;
+	friend class json_tape_builder;
+};
+
+class json_tape {
+public:
+	class options {
+	public:
+		options() : _threads(1) { }
+		options &threads(unsigned threads) {
+			_threads = threads;
+			return *this;
+		}
+		options &keep(const char *key) {
+			_keep.push_back(key);
+			return *this;
+		}
+		json_tape parse(const char *begin, const char *end) const;
+	private:
+		unsigned _threads;
+		std::vector<std::string> _keep;
+	};
+
+	json_tape() : _root(0) { }
+	json_tape(const json_tape &) = delete;
+	json_tape(json_tape &&x) = default;
+	json_tape &operator=(json_tape &&x) = default;
+	json_tape_value root() const { return json_tape_value(_data.get(), _root); }
+	json_tape_value value(uint64_t word) const { return json_tape_value(_data.get(), word); }
+	size_t size() const { return _data ? _data->size : 0; }
+	json_atom atom(const json_string &key) const;
+	void save(std::string &out) const;
+	static json_tape view(const void *data, size_t size);
+
+	static const json_atom no_atom = UINT32_MAX;
+private:
+	std::unique_ptr<json_tape_data> _data;
+	uint64_t _root;
+
+};
+
+class json_ondemand;
+
+class json_cursor {
+public:
+	class const_iterator {
+	public:
+		const_iterator &operator++();
+		json_cursor operator*() const { return json_cursor(_doc, _pos); }
+		bool operator!=(const const_iterator &x) const { return _pos != x._pos; }
+		bool operator==(const const_iterator &x) const { return _pos == x._pos; }
+	private:
+		const_iterator(const json_ondemand *doc, const uint32_t *pos) : _doc(doc), _pos(pos) { }
+		const json_ondemand *_doc;
+		const uint32_t *_pos;
+
+		friend class json_cursor;
+	};
+
+	json_cursor() : _doc(nullptr), _pos(nullptr) { }
+	bool is_null() const;
+	bool is_array() const { return _pos && kind() == '['; }
+	bool is_object() const { return _pos && kind() == '{'; }
+	__attribute__((pure)) operator json_boolean() const;
+	__attribute__((pure)) operator json_number() const;
+	__attribute__((pure)) operator json_string() const;
+	const_iterator begin() const;
+	const_iterator end() const;
+	size_t size() const;
+	json_cursor operator[](size_t i) const;
+	json_cursor operator[](const json_string &key) const;
+	bool has_key(const json_string &key) const { return (*this)[key]._pos; }
+private:
+	json_cursor(const json_ondemand *doc, const uint32_t *pos) : _doc(doc), _pos(pos) { }
+	char kind() const;
+	const uint32_t *skip(const uint32_t *pos) const;
+	json_var value() const;
+	const json_ondemand *_doc;
+	const uint32_t *_pos;
+
+	friend class json_ondemand;
+};
+
+class json_ondemand {
+public:
+	json_ondemand(const json_ondemand &) = delete;
+	json_ondemand(json_ondemand &&x) = default;
+	json_cursor root() const { return json_cursor(this, _positions.get()); }
+private:
+	json_ondemand() { }
+	const char *_begin;
+	const char *_end;
+	std::unique_ptr<uint32_t[]> _positions;
+	const uint32_t *_last;
+
+	friend class json_cursor;
+	friend json_ondemand json_parse_ondemand(const char *, const char *);
+};
+
 class json_exception : public std::exception {
 public:
 	json_exception(const char *msg) : _what(msg) {}
@@ -697,6 +1052,9 @@ public:
 
 const char *json_parse(const char *begin, const char *end, json_callbacks &cb);
 json_document json_parse(const char *begin, const char *end);
+json_tape json_parse_tape(const char *begin, const char *end);
+json_ondemand json_parse_ondemand(const char *begin, const char *end);
+const char *json_read_number(const char *begin, const char *end, json_number &value);
 
 template <class allocator>
 json_array_imp<allocator>::~json_array_imp() {
@@ -787,9 +1145,8 @@ json_object_imp<Allocator>::~json_object_imp() {
 		_head = next;
 	}
 	if(_index) {
-		typename Allocator::template rebind<node *>::other a2(_allocator);
-		size_t buckets = (size_t)_index[0];
-		a2.deallocate(_index, buckets+1);
+		typename Allocator::template rebind<slot>::other a2(_allocator);
+		a2.deallocate(_index, _index[0].hash+1);
 	}
 }
 
@@ -863,17 +1220,23 @@ void json_object_imp<Allocator>::push_back(const json_string &key, json_object_i
 	++_size;
 }
 
+// Slots are reserved while the document is built: find() is const and may run concurrently, and the
+// arena is shrunk once parsing ends, so it cannot allocate. build_index() fills them on first lookup.
 template <class Allocator>
 void json_object_imp<Allocator>::index() {
-	typename Allocator::template rebind<node *>::other a2(_allocator);
+	typename Allocator::template rebind<slot>::other a2(_allocator);
 	if(_index) {
-		size_t buckets = (size_t)_index[0];
-		a2.deallocate(_index, buckets+1);
+		a2.deallocate(_index, _index[0].hash+1);
+		_index = nullptr;
 	}
-	size_t buckets = _size / 2;
-	buckets = buckets == 0 ? 1 : buckets;
-	_index = a2.allocate(buckets+1);
-	json_object::index(buckets);
+	if(_size <= linear_limit)
+		return;
+	size_t capacity = 16;
+	while(capacity < _size*2)
+		capacity *= 2;
+	_index = a2.allocate(capacity+1);
+	_index[0].hash = capacity;
+	_index[0].value = nullptr;
 }
 
 inline json_array::const_iterator &json_array::const_iterator::operator++() {
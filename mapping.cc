@@ -59,6 +59,8 @@ void mapping::truncate(size_t size) {
 	void *drop = reinterpret_cast<char *>(_addr) + size;
 	if((_length-size) && munmap(drop, _length - size))
 		throw std::runtime_error(strerror(errno));
+	if(!size)
+		_addr = MAP_FAILED;
 	_length = size;
 	_valid_length = size;
 }
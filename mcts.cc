@@ -0,0 +1,367 @@
+#include "mcts.h"
+#include "rng.h"
+#include "simulation.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+
+namespace {
+
+const double mcts_scale = 1 << 20;
+
+struct mcts_node {
+	std::atomic<uint32_t> visits;
+	std::atomic<uint32_t> virtual_loss;
+	std::atomic<uint64_t> value;
+	std::atomic<uint32_t> first;
+	uint32_t next;
+	uint16_t action;
+
+	mcts_node() : visits(0), virtual_loss(0), value(0), first(0), next(0), action(0) { }
+};
+
+class mcts_tree {
+public:
+	mcts_tree(size_t capacity) : _nodes(new mcts_node[capacity]), _capacity(capacity), _size(1) { }
+	mcts_node &operator[](uint32_t i) { return _nodes[i]; }
+	uint32_t find(const mcts_node &parent, uint16_t action) const {
+		for(uint32_t i = parent.first.load(std::memory_order_acquire); i; i = _nodes[i].next) {
+			if(_nodes[i].action == action)
+				return i;
+		}
+		return 0;
+	}
+	uint32_t child(mcts_node &parent, uint16_t action) {
+		uint32_t head = parent.first.load(std::memory_order_acquire), fresh = 0;
+		for(;;) {
+			for(uint32_t i = head; i; i = _nodes[i].next) {
+				if(_nodes[i].action == action)
+					return i;
+			}
+			if(!fresh) {
+				fresh = _size.fetch_add(1, std::memory_order_relaxed);
+				if(fresh >= _capacity)
+					return 0;
+				_nodes[fresh].action = action;
+			}
+			_nodes[fresh].next = head;
+			if(parent.first.compare_exchange_weak(head, fresh, std::memory_order_release, std::memory_order_acquire))
+				return fresh;
+		}
+	}
+	uint32_t best(const mcts_node &parent) const {
+		uint32_t res = 0, visits = 0;
+		for(uint32_t i = parent.first.load(std::memory_order_acquire); i; i = _nodes[i].next) {
+			if(_nodes[i].visits > visits) {
+				res = i;
+				visits = _nodes[i].visits;
+			}
+		}
+		return res;
+	}
+private:
+	std::unique_ptr<mcts_node[]> _nodes;
+	size_t _capacity;
+	std::atomic<size_t> _size;
+};
+
+struct mcts_plan : simulation_plan {
+	std::vector<uint16_t> hand;
+	double max_score;
+	double exploration;
+	mcts::policy_t policy;
+
+	mcts_plan(const card_database::deck &deck, const std::vector<card_database::card> &hand, int turns, bool draw_first, double exploration, mcts::policy_t policy);
+};
+
+mcts_plan::mcts_plan(const card_database::deck &deck, const std::vector<card_database::card> &hand, int turns, bool draw_first, double exploration, mcts::policy_t policy) :
+		simulation_plan(deck, turns, draw_first), max_score(std::max(1, turns * (turns + 1) / 2)), exploration(exploration), policy(policy) {
+	for(const auto &c: hand) {
+		size_t e = 0;
+		while(e < cards.size() && deck.cards()[e].entry.index() != c.index())
+			++e;
+		auto it = std::find(library.begin(), library.end(), e);
+		if(it == library.end())
+			throw std::invalid_argument("Hand card is not in the deck");
+		library.erase(it);
+		this->hand.push_back(e);
+	}
+}
+
+uint16_t mcts_action(mcts::action_t action, size_t entry) {
+	return action == mcts::END_TURN ? 0 : 2 * entry + action;
+}
+
+mcts::action_t mcts_kind(uint16_t action) {
+	return !action ? mcts::END_TURN : (action & 1) ? mcts::PLAY_LAND : mcts::CAST;
+}
+
+size_t mcts_entry(uint16_t action) {
+	return (action - 1) >> 1;
+}
+
+class mcts_state {
+public:
+	mcts_state(const mcts_plan &plan) : _plan(plan), _seen(plan.cards.size()) {
+		_game.add(_player);
+	}
+	void reset(philox &r);
+	bool over() const { return _turn >= _plan.turns; }
+	void actions(std::vector<uint16_t> &res);
+	void apply(uint16_t action);
+	void playout(philox &r, std::vector<uint16_t> &actions);
+	double reward() const { return std::min(1.0, _score / _plan.max_score); }
+private:
+	void start_turn();
+	void take(size_t entry);
+
+	const mcts_plan &_plan;
+	class game _game;
+	class player _player;
+	std::vector<uint16_t> _hand;
+	std::vector<uint16_t> _library;
+	std::vector<uint8_t> _seen;
+	size_t _top;
+	int _turn;
+	bool _land_played;
+	unsigned _colors;
+	double _score;
+};
+
+void mcts_state::reset(philox &r) {
+	_game.clear();
+	_player.reset_mana();
+	_hand = _plan.hand;
+	_library = _plan.library;
+	r.shuffle(_library.data(), _library.size(), _plan.turns + 1);
+	_top = 0;
+	_turn = 0;
+	_colors = 0;
+	_score = 0;
+	start_turn();
+}
+
+void mcts_state::start_turn() {
+	_game.untap(_player);
+	_player.reset_mana();
+	_land_played = false;
+	if((_turn || _plan.draw_first) && _top < _library.size())
+		_hand.push_back(_library[_top++]);
+}
+
+void mcts_state::actions(std::vector<uint16_t> &res) {
+	res.clear();
+	if(over())
+		return;
+	res.push_back(mcts_action(mcts::END_TURN, 0));
+	for(uint16_t entry: _hand) {
+		if(_seen[entry])
+			continue;
+		_seen[entry] = true;
+		if(_plan.lands[entry]) {
+			if(!_land_played)
+				res.push_back(mcts_action(mcts::PLAY_LAND, entry));
+		} else if(_plan.costs[entry].exists() && _game.can_pay(_player, _plan.costs[entry]))
+			res.push_back(mcts_action(mcts::CAST, entry));
+	}
+	for(uint16_t entry: _hand)
+		_seen[entry] = false;
+}
+
+void mcts_state::take(size_t entry) {
+	auto it = std::find(_hand.begin(), _hand.end(), entry);
+	*it = _hand.back();
+	_hand.pop_back();
+}
+
+void mcts_state::apply(uint16_t action) {
+	const size_t entry = mcts_entry(action);
+	switch(mcts_kind(action)) {
+	case mcts::END_TURN:
+		if(++_turn < _plan.turns)
+			start_turn();
+		break;
+	case mcts::PLAY_LAND:
+		take(entry);
+		_colors |= _plan.cards[entry].mana_colors();
+		_game.add(_player, _plan.cards[entry]);
+		_land_played = true;
+		break;
+	case mcts::CAST:
+		if(!_game.pay(_player, _plan.costs[entry]))
+			throw std::logic_error("Illegal cast during search");
+		take(entry);
+		if(_plan.cards[entry].mana_colors())
+			_game.add(_player, _plan.cards[entry], _plan.creatures[entry]);
+		_score += _plan.cmc[entry];
+		break;
+	}
+}
+
+void mcts_state::playout(philox &r, std::vector<uint16_t> &actions) {
+	while(!over()) {
+		if(_plan.policy == mcts::RANDOM) {
+			this->actions(actions);
+			apply(actions[r.below(actions.size())]);
+			continue;
+		}
+		if(!_land_played) {
+			const int best = _plan.choose_land(_hand, _colors);
+			if(best >= 0)
+				apply(mcts_action(mcts::PLAY_LAND, _hand[best]));
+		}
+		_plan.cast_spells(_hand, _game, _player, [this](uint16_t entry) {
+			apply(mcts_action(mcts::CAST, entry));
+		});
+		apply(mcts_action(mcts::END_TURN, 0));
+	}
+}
+
+void mcts_search(const mcts_plan &plan, mcts_tree &tree, uint64_t first, uint64_t iterations, uint64_t key) {
+	mcts_state state(plan);
+	std::vector<uint16_t> actions, missing;
+	std::vector<uint32_t> path;
+	for(uint64_t iteration = first; iteration < first + iterations; ++iteration) {
+		philox r(key, iteration);
+		state.reset(r);
+		path.assign(1, 0);
+		while(!state.over()) {
+			mcts_node &parent = tree[path.back()];
+			state.actions(actions);
+			missing.clear();
+			uint32_t best = 0;
+			double best_score = -1;
+			const double log_parent = std::log(parent.visits.load(std::memory_order_relaxed) + 1.0);
+			for(uint16_t action: actions) {
+				const uint32_t i = tree.find(parent, action);
+				if(!i) {
+					missing.push_back(action);
+					continue;
+				}
+				const mcts_node &child = tree[i];
+				const double n = child.visits.load(std::memory_order_relaxed) + child.virtual_loss.load(std::memory_order_relaxed);
+				if(!n) {
+					missing.push_back(action);
+					continue;
+				}
+				const double score = child.value.load(std::memory_order_relaxed) / mcts_scale / n + plan.exploration * std::sqrt(log_parent / n);
+				if(score > best_score) {
+					best = i;
+					best_score = score;
+				}
+			}
+			if(!missing.empty()) {
+				const uint16_t action = missing[r.below(missing.size())];
+				const uint32_t i = tree.child(parent, action);
+				state.apply(action);
+				if(i) {
+					tree[i].virtual_loss.fetch_add(1, std::memory_order_relaxed);
+					path.push_back(i);
+				}
+				break;
+			}
+			tree[best].virtual_loss.fetch_add(1, std::memory_order_relaxed);
+			path.push_back(best);
+			state.apply(tree[best].action);
+		}
+		state.playout(r, actions);
+		const uint64_t value = state.reward() * mcts_scale;
+		for(size_t i = 0; i < path.size(); ++i) {
+			mcts_node &node = tree[path[i]];
+			node.visits.fetch_add(1, std::memory_order_relaxed);
+			node.value.fetch_add(value, std::memory_order_relaxed);
+			if(i)
+				node.virtual_loss.fetch_sub(1, std::memory_order_relaxed);
+		}
+	}
+}
+
+}
+
+mcts mcts::options::run() const {
+	const mcts_plan plan(*_deck, _hand, _turns, _draw_first, _exploration, _policy);
+	const auto &cards = _deck->cards();
+
+	const unsigned threads = std::max(1u, (unsigned)std::min<uint64_t>(_threads, _iterations ? _iterations : 1));
+	const unsigned trees = std::max(1u, std::min(_trees, threads));
+	const uint64_t key = json_hash_mix(_seed ^ 0x5851f42d4c957f2dULL, _deck->hash());
+	std::vector<uint64_t> first(threads), iterations(threads), capacity(trees, 1);
+	for(unsigned i = 0; i < threads; ++i) {
+		first[i] = i ? first[i - 1] + iterations[i - 1] : 0;
+		iterations[i] = _iterations / threads + (i < _iterations % threads);
+		capacity[i % trees] += iterations[i];
+	}
+	std::vector<std::unique_ptr<mcts_tree>> forest;
+	for(unsigned t = 0; t < trees; ++t)
+		forest.emplace_back(new mcts_tree(std::min<uint64_t>(capacity[t], UINT32_MAX)));
+	std::vector<std::exception_ptr> errors(threads);
+	auto run = [&](unsigned i) {
+		try {
+			mcts_search(plan, *forest[i % trees], first[i], iterations[i], key);
+		} catch(...) {
+			errors[i] = std::current_exception();
+		}
+	};
+	std::vector<std::thread> workers;
+	for(unsigned i = 1; i < threads; ++i)
+		workers.emplace_back(run, i);
+	run(0);
+	for(auto &worker: workers)
+		worker.join();
+	for(auto &error: errors) {
+		if(error)
+			std::rethrow_exception(error);
+	}
+
+	mcts res(_iterations);
+	uint64_t visits = 0, value = 0;
+	for(auto &tree: forest) {
+		visits += (*tree)[0].visits;
+		value += (*tree)[0].value;
+	}
+	res._value = visits ? value / mcts_scale / visits : 0;
+	uint16_t action = 0;
+	uint64_t best_visits = 0, best_value = 0;
+	for(auto &root: forest) {
+		for(uint32_t j = (*root)[0].first; j; j = (*root)[j].next) {
+			uint64_t n = 0, v = 0;
+			for(auto &other: forest) {
+				if(const uint32_t k = other->find((*other)[0], (*root)[j].action)) {
+					n += (*other)[k].visits;
+					v += (*other)[k].value;
+				}
+			}
+			if(n > best_visits) {
+				action = (*root)[j].action;
+				best_visits = n;
+				best_value = v;
+			}
+		}
+	}
+	if(!best_visits)
+		return res;
+	mcts_tree *tree = nullptr;
+	uint32_t node = 0, most = 0;
+	for(auto &t: forest) {
+		const uint32_t i = t->find((*t)[0], action);
+		if(i && (*t)[i].visits > most) {
+			tree = t.get();
+			node = i;
+			most = (*t)[i].visits;
+		}
+	}
+	int turn = 0;
+	res._line.push_back(step{mcts_kind(action), action ? &cards[mcts_entry(action)].entry : nullptr, turn,
+	                         best_visits, best_value / mcts_scale / best_visits});
+	turn += !action;
+	for(node = tree->best((*tree)[node]); node && turn < _turns; node = tree->best((*tree)[node])) {
+		const mcts_node &n = (*tree)[node];
+		res._line.push_back(step{mcts_kind(n.action), n.action ? &cards[mcts_entry(n.action)].entry : nullptr, turn,
+		                         n.visits, n.value / mcts_scale / n.visits});
+		turn += !n.action;
+	}
+	return res;
+}
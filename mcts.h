@@ -0,0 +1,90 @@
+#ifndef DECKEVAL_MCTS_H
+#define DECKEVAL_MCTS_H
+#include "game.h"
+#include <thread>
+#include <vector>
+
+class mcts {
+public:
+	enum action_t {END_TURN, PLAY_LAND, CAST};
+	enum policy_t {GREEDY, RANDOM};
+
+	struct step {
+		action_t action;
+		const card_database::card *card;
+		int turn;
+		uint64_t visits;
+		double value;
+	};
+
+	class options {
+	public:
+		options(const card_database::deck &deck, const std::vector<card_database::card> &hand) : _hand(hand) {
+			_deck = &deck;
+			_iterations = 100000;
+			_turns = 6;
+			_threads = std::thread::hardware_concurrency();
+			_trees = 1;
+			_seed = 0;
+			_exploration = 0.7;
+			_policy = GREEDY;
+			_draw_first = false;
+		}
+		options &iterations(uint64_t iterations) {
+			_iterations = iterations;
+			return *this;
+		}
+		options &turns(int turns) {
+			_turns = turns;
+			return *this;
+		}
+		options &threads(unsigned threads) {
+			_threads = threads;
+			return *this;
+		}
+		options &trees(unsigned trees) {
+			_trees = trees;
+			return *this;
+		}
+		options &seed(uint64_t seed) {
+			_seed = seed;
+			return *this;
+		}
+		options &exploration(double exploration) {
+			_exploration = exploration;
+			return *this;
+		}
+		options &policy(policy_t policy) {
+			_policy = policy;
+			return *this;
+		}
+		options &draw_first(bool draw_first = true) {
+			_draw_first = draw_first;
+			return *this;
+		}
+		mcts run() const;
+	private:
+		const card_database::deck *_deck;
+		std::vector<card_database::card> _hand;
+		uint64_t _iterations;
+		int _turns;
+		unsigned _threads;
+		unsigned _trees;
+		uint64_t _seed;
+		double _exploration;
+		policy_t _policy;
+		bool _draw_first;
+	};
+
+	uint64_t iterations() const { return _iterations; }
+	double value() const { return _value; }
+	const std::vector<step> &line() const { return _line; }
+private:
+	mcts(uint64_t iterations) : _iterations(iterations), _value(0) { }
+
+	uint64_t _iterations;
+	double _value;
+	std::vector<step> _line;
+};
+
+#endif
@@ -0,0 +1,66 @@
+#include "odds.h"
+#include <algorithm>
+#include <stdexcept>
+
+odds::odds(const card_database::deck &deck) : _deck(&deck), _size(0) {
+	for(const auto &entry: deck.cards())
+		_size += entry.count;
+	init();
+}
+
+odds::odds(int size) : _deck(nullptr), _size(size) {
+	init();
+}
+
+void odds::init() {
+	if(_size < 0 || _size > 1000)
+		throw std::range_error("Deck size out of range");
+	const size_t stride = _size + 1;
+	_binomial.assign(stride * stride, 0);
+	for(int n = 0; n <= _size; ++n) {
+		double *row = &_binomial[n * stride];
+		row[0] = 1;
+		for(int k = 1; k <= n; ++k)
+			row[k] = row[k - stride] + row[k - 1 - stride];
+	}
+}
+
+int odds::copies(const char *name) const {
+	const json_string key(name, strlen(name));
+	return copies([&key](const card_database::card &card) {
+		return card.name() == key;
+	});
+}
+
+double odds::sum(const requirement *requirements, size_t n, int cards, int rest) const {
+	const requirement &r = requirements[0];
+	const int low = std::max(r.at_least, 0), high = std::min(std::min(r.at_most, r.copies), cards);
+	if(n == 1) {
+		const double *copies = &_binomial[r.copies * (_size + 1)];
+		const double *others = &_binomial[rest * (_size + 1)];
+		double res = 0;
+		for(int i = std::max(low, cards - rest); i <= high; ++i)
+			res += copies[i] * others[cards - i];
+		return res;
+	}
+	double res = 0;
+	for(int i = low; i <= high; ++i) {
+		const double weight = binomial(r.copies, i);
+		if(weight)
+			res += weight * sum(requirements + 1, n - 1, cards - i, rest);
+	}
+	return res;
+}
+
+double odds::probability(const requirement *requirements, size_t n, int cards) const {
+	if(cards < 0 || cards > _size)
+		throw std::range_error("Card count out of range");
+	int rest = _size;
+	for(size_t i = 0; i < n; ++i)
+		rest -= requirements[i].copies;
+	if(rest < 0)
+		throw std::range_error("Requirements exceed the deck");
+	if(!n)
+		return 1;
+	return sum(requirements, n, cards, rest) / binomial(_size, cards);
+}
@@ -0,0 +1,53 @@
+#ifndef DECKEVAL_ODDS_H
+#define DECKEVAL_ODDS_H
+#include "carddb.h"
+#include <initializer_list>
+#include <vector>
+
+class odds {
+public:
+	struct requirement {
+		int copies;
+		int at_least;
+		int at_most;
+
+		requirement(int copies, int at_least) : copies(copies), at_least(at_least), at_most(copies) { }
+		requirement(int copies, int at_least, int at_most) : copies(copies), at_least(at_least), at_most(at_most) { }
+	};
+
+	odds(const card_database::deck &deck);
+	odds(int size);
+
+	int size() const { return _size; }
+	int copies(const char *name) const;
+	template <class Fn>
+	int copies(Fn &&fn) const {
+		int res = 0;
+		if(!_deck)
+			return res;
+		for(const auto &entry: _deck->cards()) {
+			if(fn(entry.entry))
+				res += entry.count;
+		}
+		return res;
+	}
+	static int seen(int turn, bool draw_first = false, int hand = 7) {
+		return hand + turn - (draw_first ? 0 : 1);
+	}
+	double binomial(int n, int k) const {
+		return k < 0 || k > n ? 0 : _binomial[n * (_size + 1) + k];
+	}
+	double probability(const requirement *requirements, size_t n, int cards) const;
+	double probability(std::initializer_list<requirement> requirements, int cards) const {
+		return probability(requirements.begin(), requirements.size(), cards);
+	}
+private:
+	void init();
+	double sum(const requirement *requirements, size_t n, int cards, int rest) const;
+
+	const card_database::deck *_deck;
+	int _size;
+	std::vector<double> _binomial;
+};
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef DECKEVAL_RNG_H
+#define DECKEVAL_RNG_H
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+class philox {
+public:
+	philox(uint64_t key, uint64_t stream) : _index(4) {
+		_key[0] = key;
+		_key[1] = key >> 32;
+		_counter[0] = 0;
+		_counter[1] = 0;
+		_counter[2] = stream;
+		_counter[3] = stream >> 32;
+	}
+	uint32_t next() {
+		if(_index == 4) {
+			block(_counter, _buffer);
+			advance(1);
+			_index = 0;
+		}
+		return _buffer[_index++];
+	}
+	uint32_t below(uint32_t n) {
+		return ((uint64_t)next() * n) >> 32;
+	}
+	void fill(uint32_t *out, size_t n) {
+		for(; n && _index < 4; --n)
+			*out++ = _buffer[_index++];
+		for(; n >= 4 * lanes; n -= 4 * lanes, out += 4 * lanes) {
+			uint32_t x0[lanes], x1[lanes], x2[lanes], x3[lanes];
+			const uint64_t base = (uint64_t)_counter[1] << 32 | _counter[0];
+			for(size_t i = 0; i < lanes; ++i) {
+				x0[i] = base + i;
+				x1[i] = (base + i) >> 32;
+				x2[i] = _counter[2];
+				x3[i] = _counter[3];
+			}
+			uint32_t k0 = _key[0], k1 = _key[1];
+			for(int r = 0; r < 10; ++r, k0 += W0, k1 += W1) {
+				for(size_t i = 0; i < lanes; ++i) {
+					const uint64_t p0 = (uint64_t)M0 * x0[i], p1 = (uint64_t)M1 * x2[i];
+					x0[i] = (p1 >> 32) ^ x1[i] ^ k0;
+					x1[i] = p1;
+					x2[i] = (p0 >> 32) ^ x3[i] ^ k1;
+					x3[i] = p0;
+				}
+			}
+			for(size_t i = 0; i < lanes; ++i) {
+				out[4*i] = x0[i];
+				out[4*i + 1] = x1[i];
+				out[4*i + 2] = x2[i];
+				out[4*i + 3] = x3[i];
+			}
+			advance(lanes);
+		}
+		for(; n; --n)
+			*out++ = next();
+	}
+	template <class T>
+	void shuffle(T *begin, size_t size, size_t count) {
+		uint32_t words[64];
+		count = std::min(count, size);
+		for(size_t i = 0; i < count;) {
+			const size_t n = std::min<size_t>(count - i, 64);
+			fill(words, n);
+			for(size_t j = 0; j < n; ++j, ++i)
+				std::swap(begin[i], begin[i + (((uint64_t)words[j] * (size - i)) >> 32)]);
+		}
+	}
+	void block(const uint32_t counter[4], uint32_t out[4]) const {
+		uint32_t x0 = counter[0], x1 = counter[1], x2 = counter[2], x3 = counter[3];
+		uint32_t k0 = _key[0], k1 = _key[1];
+		for(int r = 0; r < 10; ++r, k0 += W0, k1 += W1) {
+			const uint64_t p0 = (uint64_t)M0 * x0, p1 = (uint64_t)M1 * x2;
+			x0 = (p1 >> 32) ^ x1 ^ k0;
+			x1 = p1;
+			x2 = (p0 >> 32) ^ x3 ^ k1;
+			x3 = p0;
+		}
+		out[0] = x0;
+		out[1] = x1;
+		out[2] = x2;
+		out[3] = x3;
+	}
+private:
+	static const size_t lanes = 4;
+	static const uint32_t M0 = 0xd2511f53, M1 = 0xcd9e8d57, W0 = 0x9e3779b9, W1 = 0xbb67ae85;
+
+	void advance(uint64_t blocks) {
+		const uint64_t counter = ((uint64_t)_counter[1] << 32 | _counter[0]) + blocks;
+		_counter[0] = counter;
+		_counter[1] = counter >> 32;
+	}
+
+	uint32_t _key[2];
+	uint32_t _counter[4];
+	uint32_t _buffer[4];
+	unsigned _index;
+};
+
+#endif
@@ -0,0 +1,35 @@
+#include "simulation.h"
+#include <algorithm>
+
+simulation_plan::simulation_plan(const card_database::deck &deck, int turns, bool draw_first) : turns(turns), draw_first(draw_first) {
+	const auto &table = deck.database().table();
+	for(const auto &entry: deck.cards()) {
+		const auto index = entry.entry.index();
+		library.insert(library.end(), entry.count, cards.size());
+		cards.emplace_back(entry.entry);
+		costs.push_back(entry.entry.mana_cost());
+		cmc.push_back(table.cmc()[index]);
+		lands.push_back(table.types()[index] & card_database::LAND);
+		creatures.push_back(table.types()[index] & card_database::CREATURE);
+	}
+}
+
+int simulation_plan::choose_land(const std::vector<uint16_t> &hand, unsigned colors) const {
+	int best = -1, best_colors = -1;
+	for(size_t i = 0; i < hand.size(); ++i) {
+		if(!lands[hand[i]])
+			continue;
+		const int added = __builtin_popcount(cards[hand[i]].mana_colors() & ~colors);
+		if(added > best_colors || (added == best_colors && hand[i] < hand[best])) {
+			best = i;
+			best_colors = added;
+		}
+	}
+	return best;
+}
+
+void simulation_plan::sort_hand(std::vector<uint16_t> &hand) const {
+	std::sort(hand.begin(), hand.end(), [this](uint16_t a, uint16_t b) {
+		return cmc[a] > cmc[b] || (cmc[a] == cmc[b] && a < b);
+	});
+}
@@ -0,0 +1,38 @@
+#ifndef DECKEVAL_SIMULATION_H
+#define DECKEVAL_SIMULATION_H
+#include "game.h"
+#include <vector>
+
+struct simulation_plan {
+	std::vector<card> cards;
+	std::vector<card_database::cost> costs;
+	std::vector<int> cmc;
+	std::vector<bool> lands;
+	std::vector<bool> creatures;
+	std::vector<uint16_t> library;
+	int turns;
+	bool draw_first;
+
+	simulation_plan(const card_database::deck &deck, int turns, bool draw_first);
+	bool castable(uint16_t entry, const game &g, const player &p) const {
+		return !lands[entry] && costs[entry].exists() && g.can_pay(p, costs[entry]);
+	}
+	int choose_land(const std::vector<uint16_t> &hand, unsigned colors) const;
+	void sort_hand(std::vector<uint16_t> &hand) const;
+	template <class Cast>
+	void cast_spells(std::vector<uint16_t> &hand, const game &g, const player &p, Cast &&cast) const {
+		for(bool again = true; again;) {
+			again = false;
+			sort_hand(hand);
+			for(uint16_t entry: hand) {
+				if(castable(entry, g, p)) {
+					cast(entry);
+					again = true;
+					break;
+				}
+			}
+		}
+	}
+};
+
+#endif
@@ -1,7 +1,14 @@
 #include "carddb.h"
 #include "game.h"
+#include "goldfish.h"
+#include "odds.h"
+#include "mcts.h"
+#include "rng.h"
+#include "file.h"
 #include <iostream>
+#include <atomic>
 #include <memory>
+#include <thread>
 
 class const_str {
 public:
@@ -83,6 +90,12 @@ bool test_dual_land(const char *name, const char *result1, const char *result2)
 	return res;
 }
 
+card_database::deck test_mono_red() {
+	return sets->make_deck("{\"name\": \"Mono red\", \"deck\": ["
+		"{\"name\": \"Mountain\", \"count\": 20}, {\"name\": \"Lightning Bolt\", \"count\": 4},"
+		"{\"name\": \"Sol Ring\", \"count\": 4}, {\"name\": \"Shivan Dragon\", \"count\": 4}], \"sideboard\": []}");
+}
+
 int main(int argc, char *argv[]) {
 	game.add(player);
 	std::unique_ptr<test> tests[] = {
@@ -143,6 +156,489 @@ int main(int argc, char *argv[]) {
 			       x.text() == "Flying (This creature can't be blocked except by creatures with flying or reach.)\n{R}: Shivan Dragon gets +1/+0 until end of turn." &&
 			       x.power() == "5" &&
 			       x.toughness() == "5";
+		}),
+		new_test("JSON escapes straddling index blocks parse", []() {
+			std::string padding(61, 'x');
+			std::string text = "[\"" + padding + "\\\"\\\\\", \"plain\", {\"key\": [1, true, null]}]";
+			json_document doc = json_parse(&*text.begin(), &*text.end());
+			json_array values = doc;
+			auto it = values.begin();
+			if(!(json_string(*it) == (padding + "\"\\").c_str()))
+				return false;
+			if(!(json_string(*++it) == "plain"))
+				return false;
+			json_object object = *++it;
+			return json_array(object["key"]).size() == 3;
+		}),
+		new_test("JSON numbers parse exactly", []() {
+			const char text[] = "[9007199254740993, -42, 0.1, 1e23, 2.5e-3, 1e30]";
+			json_document doc = json_parse(text, text+sizeof(text)-1);
+			json_array values = doc;
+			auto it = values.begin();
+			json_number big = *it, negative = *++it, tenth = *++it, large = *++it, small = *++it, huge = *++it;
+			bool ranged = false;
+			try {
+				huge.integer();
+			} catch(const std::range_error &) {
+				ranged = true;
+			}
+			return ranged && big.is_integer() && big.integer() == 9007199254740993LL &&
+			       negative.is_integer() && negative.integer() == -42 &&
+			       !tenth.is_integer() && (double)tenth == 0.1 &&
+			       (double)large == 1e23 &&
+			       (double)small == 2.5e-3;
+		}),
+		new_test("Shivan Dragon has integer fields", []() {
+			auto x = sets->find_card("Shivan Dragon");
+			return x.cmc() == 6 && x.loyalty() == 0;
+		}),
+		new_test("Mana costs add, subtract and compare", []() {
+			card_database::cost pool("{2}{W}{U}{U}"), requirement("{1}{U}"), big("{100}");
+			card_database::cost sum = pool;
+			sum += requirement;
+			card_database::cost rest = pool;
+			rest -= requirement;
+			bool overflowed = false;
+			try {
+				card_database::cost x("{W}");
+				for(int i = 0; i < 200; ++i)
+					x += card_database::cost("{W}");
+			} catch(const std::overflow_error &) {
+				overflowed = true;
+			}
+			return sum == card_database::cost("{3}{W}{U}{U}{U}") && sum.hash() == card_database::cost("{3}{W}{U}{U}{U}").hash() &&
+			       rest.generic() == 1 && rest.white() == 1 && rest.blue() == 1 && rest.exists() &&
+			       pool.covers(requirement) && !requirement.covers(pool) && !pool.covers(big) &&
+			       overflowed;
+		}),
+		new_test("Mana cost parser reports status codes", []() {
+			using cost = card_database::cost;
+			const json_string inputs[] = {"{2/W}{G/P}{B/U}{10}", "{W", "{K}", "{1}{2}", "{99999999999}", ""};
+			cost parsed[6];
+			cost::status statuses[6];
+			size_t invalid = cost::parse(inputs, 6, parsed, statuses);
+			return invalid == 4 &&
+			       statuses[0] == cost::VALID && parsed[0].twowhite() == 1 && parsed[0].greenphyrexian() == 1 &&
+			       parsed[0].blueblack() == 1 && parsed[0].generic() == 10 && parsed[0].exists() &&
+			       statuses[1] == cost::UNTERMINATED && statuses[2] == cost::UNKNOWN_SYMBOL &&
+			       statuses[3] == cost::REPEATED_GENERIC && statuses[4] == cost::TOO_LARGE &&
+			       statuses[5] == cost::VALID && !parsed[5].exists();
+		}),
+		new_test("Mana solver pays hybrid, two-brid and phyrexian costs", []() {
+			using db = card_database;
+			mana_solver solver;
+			solver.add(db::WHITE);
+			solver.add(db::BLUE);
+			solver.add(db::WHITE | db::BLUE);
+			solver.add(db::GREEN);
+			mana_solver::payment payment;
+			bool paid = solver.pay(db::cost("{1}{W}{W}{U}"), payment);
+			int white = 0, used = 0;
+			for(unsigned color: payment.produce) {
+				white += color == db::WHITE;
+				used += color != 0;
+			}
+			return paid && white == 2 && used == 4 &&
+			       solver.can_pay(db::cost("{W/U}{W/U}{W/U}{G}")) &&
+			       solver.can_pay(db::cost("{2/W}{2/W}")) &&
+			       !solver.can_pay(db::cost("{W}{W}{W}")) &&
+			       !solver.can_pay(db::cost("{W/P}{W/P}{W/P}")) &&
+			       solver.can_pay(db::cost("{W/P}{W/P}{W/P}"), 0, 2) &&
+			       !solver.can_pay(db::cost("{C}")) &&
+			       solver.can_pay(db::cost("{X}{G}"), 3) && !solver.can_pay(db::cost("{X}{G}"), 4);
+		}),
+		new_test("Lands pay for spells through the mana solver", []() {
+			class game g;
+			class player p;
+			g.add(p);
+			g.add(p, card(sets->find_card("Plains")));
+			g.add(p, card(sets->find_card("Tropical Island")));
+			return g.can_pay(p, card_database::cost("{W}{U}")) &&
+			       !g.can_pay(p, card_database::cost("{G}{U}")) &&
+			       g.pay(p, card_database::cost("{W}{U}")) &&
+			       !p.mana_pool().white() && !p.mana_pool().blue() &&
+			       !g.can_pay(p, card_database::cost("{W}"));
+		}),
+		new_test("Mana abilities are read from card text", []() {
+			using db = card_database;
+			const card birds(sets->find_card("Birds of Paradise")), ring(sets->find_card("Sol Ring"));
+			const card elves(sets->find_card("Llanowar Elves")), signet(sets->find_card("Boros Signet"));
+			class game g;
+			class player p;
+			g.add(p);
+			g.add(p, ring);
+			g.add(p, elves);
+			return birds.mana_colors() == (db::WHITE | db::BLUE | db::BLACK | db::RED | db::GREEN) &&
+			       birds.mana(birds.mana_option(db::RED)) == db::cost("{R}") &&
+			       ring.mana_colors() == db::COLORLESS && ring.mana_amount() == 2 && ring.mana(0) == db::cost("{C}{C}") &&
+			       elves.mana_colors() == db::GREEN && !signet.mana_colors() &&
+			       &elves.mana() == &sets->find_card("Elvish Mystic").mana() &&
+			       g.can_pay(p, db::cost("{2}{G}")) && !g.can_pay(p, db::cost("{3}{G}")) &&
+			       g.pay(p, db::cost("{1}{G}")) && p.mana_pool() == db::cost("{C}") &&
+			       g.can_pay(p, db::cost("{1}")) && !g.can_pay(p, db::cost("{2}")) &&
+			       g.pay(p, db::cost("{1}")) && !p.mana_pool().colorless();
+		}),
+		new_test("Permanent handles stay valid across removals", []() {
+			class game g;
+			class player p;
+			g.add(p);
+			auto plains = g.add(p, card(sets->find_card("Plains")));
+			auto island = g.add(p, card(sets->find_card("Island")));
+			auto forest = g.add(p, card(sets->find_card("Forest")));
+			g.remove(plains);
+			island.tap();
+			auto mountain = g.add(p, card(sets->find_card("Mountain")));
+			bool stale = false;
+			try {
+				plains.tap();
+			} catch(const std::out_of_range &) {
+				stale = true;
+			}
+			return stale && !plains.valid() && island.valid() && forest.valid() && mountain.valid() &&
+			       mountain.slot() == plains.slot() && mountain != plains && g.size() == 3 &&
+			       island.tapped() && !forest.tapped() && &island.controller() == &p &&
+			       forest.card().name() == "Forest" && p.mana_pool().blue() == 1;
+		}),
+		new_test("Battlefield selections track controller, tapped state, type and colour", []() {
+			using db = card_database;
+			class game g;
+			class player p, q;
+			g.add(p);
+			g.add(q);
+			auto forest = g.add(p, card(sets->find_card("Forest")));
+			auto elves = g.add(p, card(sets->find_card("Llanowar Elves")), true);
+			auto taiga = g.add(p, card(sets->find_card("Taiga")));
+			g.add(q, card(sets->find_card("Forest")));
+			for(int i = 0; i < 70; ++i)
+				g.add(q, card(sets->find_card("Island")));
+			forest.tap();
+			const size_t untapped = g.select().controller(p).tapped(false).type(db::LAND).count();
+			const size_t green = g.select().controller(p).produces(db::GREEN).count();
+			const size_t islands = g.select().controller(q).produces(db::BLUE).tapped(false).count();
+			g.remove(forest);
+			g.untap(p);
+			size_t creatures = 0;
+			g.select().controller(p).type(db::CREATURE).tapped(false).each([&](permanent x) {
+				creatures += x == elves;
+			});
+			return untapped == 1 && green == 3 && islands == 70 && creatures == 1 && !taiga.tapped() &&
+			       g.select().controller(p).tapped().empty() && g.select().type(db::LAND).count() == 72;
+		}),
+		new_test("Rolling back a checkpoint restores the battlefield and mana pools", []() {
+			using db = card_database;
+			class game g;
+			class player p;
+			g.add(p);
+			auto forest = g.add(p, card(sets->find_card("Forest")));
+			auto island = g.add(p, card(sets->find_card("Island")));
+			auto taiga = g.add(p, card(sets->find_card("Taiga")));
+			island.tap();
+			const size_t outer = g.checkpoint();
+			forest.tap();
+			g.remove(forest);
+			const size_t inner = g.checkpoint();
+			auto elves = g.add(p, card(sets->find_card("Llanowar Elves")));
+			g.untap(p);
+			g.commit(inner);
+			const bool branched = g.size() == 3 && elves.valid() && !forest.valid() && !island.tapped();
+			g.rollback(outer);
+			return branched && !elves.valid() && forest.valid() && g.size() == 3 &&
+			       g.get_permanent(0) == forest && g.get_permanent(1) == island && g.get_permanent(2) == taiga &&
+			       !forest.tapped() && island.tapped() && p.mana_pool() == db::cost("{U}") &&
+			       g.select().controller(p).produces(db::GREEN).count() == 2 && g.select().tapped().count() == 1;
+		}),
+		new_test("Goldfish games cast spells on curve", []() {
+			auto deck = test_mono_red();
+			auto res = goldfish::options(deck).games(2000).turns(8).threads(2).seed(1).run();
+			const auto &mountain = res.cards()[0], &bolt = res.cards()[1], &dragon = res.cards()[3];
+			uint64_t bolts = 0;
+			for(uint64_t n: bolt.cast)
+				bolts += n;
+			return res.games() == 2000 && mountain.cast[0] > 1900 &&
+			       bolt.cast[0] > 0 && bolts + bolt.uncast == 2000 * 4 &&
+			       dragon.cast[0] == 0 && dragon.cast[1] > 0;
+		}),
+		new_test("Goldfish results do not depend on the thread count", []() {
+			auto deck = test_mono_red();
+			auto one = goldfish::options(deck).games(1000).turns(6).threads(1).seed(7).run();
+			auto three = goldfish::options(deck).games(1000).turns(6).threads(3).seed(7).run();
+			auto other = goldfish::options(deck).games(1000).turns(6).threads(3).seed(8).run();
+			bool same = true, differs = false;
+			for(size_t e = 0; e < one.cards().size(); ++e) {
+				same = same && one.cards()[e].cast == three.cards()[e].cast;
+				differs = differs || one.cards()[e].cast != other.cards()[e].cast;
+			}
+			return same && differs;
+		}),
+		new_test("Batched goldfish games match full games on a mono-colored deck", []() {
+			auto deck = test_mono_red();
+			auto full = goldfish::options(deck).games(1003).turns(8).threads(2).seed(5).run();
+			auto simple = goldfish::options(deck).games(1003).turns(8).threads(2).seed(5).rules(goldfish::SIMPLE).run();
+			bool same = true;
+			for(size_t e = 0; e < full.cards().size(); ++e)
+				same = same && full.cards()[e].cast == simple.cards()[e].cast && full.cards()[e].uncast == simple.cards()[e].uncast;
+			return same && simple.cards()[3].cast[5] > 0;
+		}),
+		new_test("Batched goldfish games spend each colored source once", []() {
+			auto deck = sets->make_deck("{\"name\": \"Gruul\", \"deck\": ["
+				"{\"name\": \"Mountain\", \"count\": 8}, {\"name\": \"Forest\", \"count\": 16},"
+				"{\"name\": \"Lightning Bolt\", \"count\": 18}, {\"name\": \"Llanowar Elves\", \"count\": 18}], \"sideboard\": []}");
+			auto full = goldfish::options(deck).games(2000).threads(2).seed(3).run();
+			auto simple = goldfish::options(deck).games(2000).threads(2).seed(3).rules(goldfish::SIMPLE).run();
+			uint64_t full_bolts = 0, simple_bolts = 0;
+			for(int turn = 0; turn < full.turns(); ++turn) {
+				full_bolts += full.cards()[2].cast[turn];
+				simple_bolts += simple.cards()[2].cast[turn];
+			}
+			return simple_bolts * 100 <= full_bolts * 101 && full_bolts * 100 <= simple_bolts * 101;
+		}),
+		new_test("Tree search plays a mana creature on turn one", []() {
+			auto deck = sets->make_deck("{\"name\": \"Gruul\", \"deck\": ["
+				"{\"name\": \"Mountain\", \"count\": 10}, {\"name\": \"Forest\", \"count\": 10},"
+				"{\"name\": \"Lightning Bolt\", \"count\": 10}, {\"name\": \"Llanowar Elves\", \"count\": 10},"
+				"{\"name\": \"Kitchen Finks\", \"count\": 10}, {\"name\": \"Shivan Dragon\", \"count\": 10}], \"sideboard\": []}");
+			std::vector<card_database::card> hand = {
+				sets->find_card("Forest"), sets->find_card("Mountain"), sets->find_card("Llanowar Elves"),
+				sets->find_card("Lightning Bolt"), sets->find_card("Shivan Dragon"), sets->find_card("Forest"),
+				sets->find_card("Kitchen Finks")
+			};
+			auto res = mcts::options(deck, hand).iterations(20000).turns(5).threads(2).trees(2).seed(1).run();
+			const auto &line = res.line();
+			return line.size() >= 3 && res.value() > 0 && res.value() <= 1 &&
+			       line[0].action == mcts::PLAY_LAND && line[0].card->name() == "Forest" &&
+			       line[1].action == mcts::CAST && line[1].card->name() == "Llanowar Elves" &&
+			       line[2].action == mcts::END_TURN && line[2].turn == 0;
+		}),
+		new_test("Philox matches known answers and shuffles in bulk", []() {
+			const uint32_t zero[4] = {0, 0, 0, 0}, ones[4] = {~0u, ~0u, ~0u, ~0u};
+			uint32_t a[4], b[4];
+			philox(0, 0).block(zero, a);
+			philox(~0ull, 0).block(ones, b);
+			philox r(42, 3), s(42, 3);
+			std::vector<uint32_t> words(37);
+			r.next();
+			r.fill(words.data(), words.size());
+			bool bulk = true;
+			s.next();
+			for(uint32_t w: words)
+				bulk = bulk && w == s.next();
+			std::vector<int> cards(60);
+			for(int i = 0; i < 60; ++i)
+				cards[i] = i;
+			philox(42, 4).shuffle(cards.data(), cards.size(), 10);
+			std::vector<int> sorted = cards;
+			std::sort(sorted.begin(), sorted.end());
+			bool permutation = true;
+			for(int i = 0; i < 60; ++i)
+				permutation = permutation && sorted[i] == i;
+			return a[0] == 0x6627e8d5 && a[1] == 0xe169c58d && a[2] == 0xbc57ac4c && a[3] == 0x9b00dbd8 &&
+			       b[0] == 0x408f276d && b[1] == 0x41c83b0e && b[2] == 0xa20bc7c6 && b[3] == 0x6d5451fd &&
+			       bulk && permutation;
+		}),
+		new_test("Hypergeometric odds match exact values", []() {
+			odds deck(60);
+			double lands = deck.probability({odds::requirement(24, 3)}, 7);
+			double pair = deck.probability({odds::requirement(4, 1), odds::requirement(4, 1)}, 10);
+			double none = deck.probability({odds::requirement(4, 0, 0)}, odds::seen(1, true));
+			return std::abs(lands - 0.5879294964471378) < 1e-12 &&
+			       std::abs(pair - 0.2652723229103529) < 1e-12 &&
+			       std::abs(none - deck.binomial(56, 8) / deck.binomial(60, 8)) < 1e-12 &&
+			       odds::seen(1) == 7 && odds::seen(3, true) == 10;
+		}),
+		new_test("Card table columns match card fields", []() {
+			const auto &table = sets->table();
+			auto x = sets->find_card("Shivan Dragon");
+			auto i = x.index();
+			size_t lands = 0;
+			for(size_t j = 0; j < table.size(); ++j)
+				lands += (table.types()[j] & card_database::LAND) != 0;
+			return table.cmc()[i] == 6 && table.colors()[i] == card_database::RED &&
+			       table.types()[i] == card_database::CREATURE && table.supertypes()[i] == 0 &&
+			       table.power()[i] == 5 && table.toughness()[i] == 5 &&
+			       table.stats()[i] == (card_database::HAS_POWER | card_database::HAS_TOUGHNESS) &&
+			       table.costs()[table.cost_index()[i]] == card_database::cost("{4}{R}{R}") &&
+			       sets->get_card(i).name() == "Shivan Dragon" &&
+			       (table.supertypes()[sets->find_card("Plains").index()] & card_database::BASIC) &&
+			       lands > 0;
+		}),
+		new_test("Card database snapshot round-trips", []() {
+			sets->save("cards.db");
+			card_database snapshot("cards.db");
+			unlink("cards.db");
+			auto x = snapshot.find_card("Shivan Dragon");
+			auto y = snapshot.find_card("Tropical Island");
+			size_t count = 0;
+			for(auto set: snapshot.sets())
+				count += set.cards().size();
+			size_t expected = 0;
+			for(auto set: sets->sets())
+				expected += set.cards().size();
+			const auto &table = snapshot.table(), &original = sets->table();
+			bool columns = table.size() == original.size() && table.cost_count() == original.cost_count();
+			for(size_t i = 0; columns && i < table.size(); ++i) {
+				columns = table.cmc()[i] == original.cmc()[i] && table.types()[i] == original.types()[i] &&
+				          table.colors()[i] == original.colors()[i] && table.stats()[i] == original.stats()[i] &&
+				          table.costs()[table.cost_index()[i]] == original.costs()[original.cost_index()[i]];
+				const auto &mana = table.mana_abilities()[table.mana_index()[i]];
+				const auto &expected_mana = original.mana_abilities()[original.mana_index()[i]];
+				columns = columns && mana.count == expected_mana.count && mana.colors == expected_mana.colors &&
+				          std::equal(table.mana_options() + mana.first, table.mana_options() + mana.first + mana.count,
+				                     original.mana_options() + expected_mana.first);
+			}
+			return x.mana_cost() == card_database::cost("{4}{R}{R}") &&
+			       x.cmc() == 6 && x.power() == "5" &&
+			       y.type() == sets->find_card("Tropical Island").type() &&
+			       count == expected && columns && table.cmc() != original.cmc() &&
+			       snapshot.find_card("Llanowar Elves").mana().colors == card_database::GREEN;
+		}),
+		new_test("Card database snapshots reject out-of-range name slots", []() {
+			sets->save("cards.db");
+			std::string out = file::options("cards.db").open().contents();
+			const uint64_t hash = json_string("Shivan Dragon", 13).hash(), card = UINT64_MAX;
+			const size_t slot = out.rfind(std::string((const char *)&hash, sizeof(hash)));
+			bool rejected = false;
+			if(slot != std::string::npos) {
+				out.replace(slot + sizeof(hash), sizeof(card), (const char *)&card, sizeof(card));
+				file::options("cards.db").write().truncate().open().write(out.data(), out.size());
+				try {
+					card_database snapshot("cards.db");
+				} catch(const std::runtime_error &) {
+					rejected = true;
+				}
+			}
+			unlink("cards.db");
+			return rejected;
+		}),
+		new_test("JSON object lookups work on small and large objects", []() {
+			std::string text = "{";
+			for(int i = 0; i < 20; ++i)
+				text += (i ? ",\"k" : "\"k") + std::to_string(i) + "\":" + std::to_string(i);
+			text += "}";
+			json_document doc = json_parse(text.data(), text.data()+text.size());
+			const char small[] = "{\"a\":1,\"b\":2}";
+			json_document doc2 = json_parse(small, small+sizeof(small)-1);
+			json_object big = doc, little = doc2;
+			return json_number(big["k0"]).integer() == 0 &&
+			       json_number(big["k19"]).integer() == 19 &&
+			       !big.has_key("k20") && !big.has_key("k") &&
+			       json_number(little["b"]).integer() == 2 &&
+			       !little.has_key("c");
+		}),
+		new_test("JSON object lookups are safe from several threads", []() {
+			std::string text = "{";
+			for(int i = 0; i < 20; ++i)
+				text += (i ? ",\"k" : "\"k") + std::to_string(i) + "\":" + std::to_string(i);
+			text += "}";
+			json_document doc = json_parse(text.data(), text.data()+text.size());
+			const json_object object = doc;
+			std::atomic<int> found(0);
+			std::vector<std::thread> threads;
+			for(int t = 0; t < 4; ++t) {
+				threads.emplace_back([&]() {
+					for(int i = 0; i < 20; ++i) {
+						const std::string key = "k" + std::to_string(i);
+						found += json_number(object[key.c_str()]).integer() == i;
+					}
+				});
+			}
+			for(auto &thread: threads)
+				thread.join();
+			return found == 80;
+		}),
+		new_test("JSON tape supports random access", []() {
+			const char text[] = "{\"a\": [1, \"two\", [3], {\"b\": null}], \"c\\n\": false}";
+			json_tape tape = json_parse_tape(text, text+sizeof(text)-1);
+			json_tape_object root = tape.root();
+			json_tape_array a = root["a"];
+			return root.size() == 2 && a.size() == 4 &&
+			       json_number(a[0]).integer() == 1 &&
+			       json_string(a[1]) == "two" &&
+			       json_tape_array(a[2]).size() == 1 &&
+			       json_tape_object(a[3])["b"].is_null() &&
+			       root.has_key("c\n") && !json_boolean(root["c\n"]) &&
+			       !root.has_key("d") &&
+			       json_tape_array(root[tape.atom("a")]).size() == 4 &&
+			       tape.atom("d") == json_tape::no_atom &&
+			       json_tape_object(a[3]).begin()->first == "b";
+		}),
+		new_test("JSON tape snapshots reject out-of-range references", []() {
+			const char text[] = "{\"name\": \"Shivan Dragon\", \"n\": [1, 2]}";
+			std::string out;
+			json_parse_tape(text, text+sizeof(text)-1).save(out);
+			std::vector<uint64_t> words((out.size() + 7) / 8);
+			memcpy(words.data(), out.data(), out.size());
+			json_tape tape = json_tape::view(words.data(), out.size());
+			const bool valid = json_string(json_tape_object(tape.root())["name"]) == "Shivan Dragon";
+			bool strings = false, root = false;
+			words[6] = 4;
+			try {
+				json_string(json_tape_object(json_tape::view(words.data(), out.size()).root())["name"]);
+			} catch(const std::runtime_error &) {
+				strings = true;
+			}
+			words[2] |= UINT32_MAX;
+			try {
+				json_tape::view(words.data(), out.size());
+			} catch(const std::runtime_error &) {
+				root = true;
+			}
+			return valid && strings && root;
+		}),
+		new_test("JSON tape parses top-level members in parallel", []() {
+			const char text[] = "{\"A\": {\"x\": [1, 2.5, \"s\\n\"]}, \"B\": [true, null], \"C\": \"c\", \"D\": {\"x\": 12345678901234567890}}";
+			json_tape tape = json_tape::options().threads(3).parse(text, text+sizeof(text)-1);
+			json_tape_object root = tape.root();
+			json_atom x = tape.atom("x");
+			json_tape_array a = json_tape_object(root["A"])[x];
+			return root.size() == 4 && a.size() == 3 &&
+			       (double)json_number(a[1]) == 2.5 && json_string(a[2]) == "s\n" &&
+			       json_boolean(json_tape_array(root["B"])[0]) &&
+			       json_string(root["C"]) == "c" &&
+			       (double)json_number(json_tape_object(root["D"])[x]) == 12345678901234567890.0;
+		}),
+		new_test("JSON tape projection keeps only listed nested keys", []() {
+			const char text[] = "{\"A\": {\"name\": \"x\", \"rulings\": [{\"text\": \"y\"}], \"cards\": [{\"name\": \"z\", \"flavor\": {\"a\": [1, [2]]}}]}, \"B\": {}}";
+			json_tape tape = json_tape::options().keep("name").keep("cards").parse(text, text+sizeof(text)-1);
+			json_tape_object root = tape.root();
+			json_tape_object a = root["A"];
+			json_tape_object card = json_tape_array(a["cards"])[0];
+			return root.size() == 2 && a.size() == 2 && !a.has_key("rulings") &&
+			       card.size() == 1 && json_string(card["name"]) == "z";
+		}),
+		new_test("JSON cursor reads fields on demand", []() {
+			const char text[] = "{\"skip\": [{\"a\": [1, 2]}, \"]\"], \"name\": \"Sol\\u0020Ring\", \"cmc\": 1, \"list\": [true, null, \"x\"], \"k\\u00e9y\": \"\\u00e9\\n\"}";
+			json_ondemand doc = json_parse_ondemand(text, text+sizeof(text)-1);
+			json_cursor root = doc.root();
+			json_cursor list = root["list"];
+			return json_string(root["name"]) == "Sol Ring" &&
+			       json_number(root["cmc"]).integer() == 1 &&
+			       list.size() == 3 && json_boolean(list[0]) && list[1].is_null() &&
+			       json_string(list[2]) == "x" && root["skip"].size() == 2 &&
+			       json_string(root["k\xc3\xa9y"]) == "\xc3\xa9\n" && !root.has_key("missing");
+		}),
+		new_test("JSON string hashes agree", []() {
+			const char text[] = "[\"Lightning Bolt\", \"Lightning\\u0020Bolt\", \"a\", \"\", \"Jace, the Mind Sculptor\","
+				"\"Jace,\\u0020the Mind Sculptor\", \"0123456789abcdef\\n0123456789abcdef\\t0123456789abcdef\", \"\\u00e9\\u00e9\\u00e9\\u00e9\\u00e9\\u00e9\\u00e9\\u00e9\"]";
+			json_document doc = json_parse(text, text+sizeof(text)-1);
+			std::vector<json_string> keys;
+			for(const json_string &x: json_array(doc))
+				keys.push_back(x);
+			bool res = keys[0].hash() == keys[1].hash() && keys[0].hash() != keys[2].hash() && keys[4].hash() == keys[5].hash();
+			for(size_t i = 0; i < keys.size(); ++i) {
+				const std::string flat = keys[i];
+				res &= keys[i].hash() == std::hash<json_string>()(keys[i]) && keys[i].hash() == json_hash(flat.data(), flat.size());
+			}
+			return res;
+		}),
+		new_test("JSON rejects malformed input", []() {
+			const char *inputs[] = {"[1 2]", "{\"a\" 1}", "[tru]", "\"abc", "{1:2}", "[1}"};
+			for(const char *input: inputs) {
+				try {
+					json_parse(input, input+strlen(input));
+					return false;
+				} catch (const json_exception &e) { }
+			}
+			return true;
 		})
 	};
 	for(const auto &t: tests) {